@@ -0,0 +1,49 @@
+#pragma once
+
+// ----------------------------------------------------------------
+// Arduino core for the native simulation build (env:native)
+//
+// Provides the parts of the arduino-esp32 core the firmware uses so
+// src/ compiles unchanged on a Linux host. Time comes from sim::Clock,
+// which can run faster than real time.
+// ----------------------------------------------------------------
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <math.h>
+
+#include "pgmspace.h"
+#include "esp32-hal.h"
+#include "WString.h"
+#include "Printable.h"
+#include "Print.h"
+#include "Stream.h"
+#include "IPAddress.h"
+#include "HardwareSerial.h"
+#include "Esp.h"
+
+typedef bool boolean;
+typedef uint8_t byte;
+typedef uint16_t word;
+
+using std::max;
+using std::min;
+
+#define _min(a, b) ((a) < (b) ? (a) : (b))
+#define _max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+long map(long x, long in_min, long in_max, long out_min, long out_max);
+
+// backed by esp_random(), like arduino-esp32
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+void setup(void);
+void loop(void);
@@ -0,0 +1,154 @@
+#include "EEPROM.h"
+#include "simConfig.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+EEPROMClass EEPROM;
+
+bool EEPROMClass::begin(size_t newSize)
+{
+    if (data)
+    {
+        free(data);
+    }
+
+    size = newSize;
+    data = static_cast<uint8_t *>(malloc(size));
+    if (!data)
+    {
+        size = 0;
+        return false;
+    }
+
+    // an erased flash page reads as 0xFF
+    memset(data, 0xFF, size);
+
+    FILE *file = fopen(sim::config().eepromPath, "rb");
+    if (file)
+    {
+        size_t n = fread(data, 1, size, file);
+        (void)n;
+        fclose(file);
+    }
+    return true;
+}
+
+void EEPROMClass::end()
+{
+    commit();
+    free(data);
+    data = nullptr;
+    size = 0;
+}
+
+bool EEPROMClass::commit()
+{
+    if (!data)
+    {
+        return false;
+    }
+    if (!dirty)
+    {
+        return true;
+    }
+
+    FILE *file = fopen(sim::config().eepromPath, "wb");
+    if (!file)
+    {
+        return false;
+    }
+    bool ok = fwrite(data, 1, size, file) == size;
+    ok = fclose(file) == 0 && ok;
+    dirty = !ok;
+    return ok;
+}
+
+uint8_t EEPROMClass::read(int address)
+{
+    if (!data || address < 0 || static_cast<size_t>(address) >= size)
+    {
+        return 0;
+    }
+    return data[address];
+}
+
+void EEPROMClass::write(int address, uint8_t val)
+{
+    if (!data || address < 0 || static_cast<size_t>(address) >= size)
+    {
+        return;
+    }
+    if (data[address] != val)
+    {
+        data[address] = val;
+        dirty = true;
+    }
+}
+
+uint8_t *EEPROMClass::getDataPtr()
+{
+    dirty = true;
+    return data;
+}
+
+size_t EEPROMClass::writeByte(int address, uint8_t value)
+{
+    write(address, value);
+    return 1;
+}
+
+size_t EEPROMClass::readBytes(int address, void *value, size_t maxLen)
+{
+    if (!data || !value || address < 0 || address + maxLen > size)
+    {
+        return 0;
+    }
+    memcpy(value, data + address, maxLen);
+    return maxLen;
+}
+
+size_t EEPROMClass::writeBytes(int address, const void *value, size_t len)
+{
+    if (!data || !value || address < 0 || address + len > size)
+    {
+        return 0;
+    }
+    if (memcmp(data + address, value, len) != 0)
+    {
+        memcpy(data + address, value, len);
+        dirty = true;
+    }
+    return len;
+}
+
+String EEPROMClass::readString(int address)
+{
+    if (!data || address < 0 || static_cast<size_t>(address) >= size)
+    {
+        return String();
+    }
+
+    size_t len = 0;
+    while (address + len < size && data[address + len] != 0)
+    {
+        len++;
+    }
+    return String(reinterpret_cast<const char *>(data + address), len);
+}
+
+size_t EEPROMClass::writeString(int address, const char *value)
+{
+    if (!value)
+    {
+        return 0;
+    }
+    size_t len = strlen(value);
+    if (!data || address < 0 || address + len + 1 > size)
+    {
+        return 0;
+    }
+    writeBytes(address, value, len + 1);
+    return len;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "WString.h"
+
+// EEPROM emulation backed by a file on the host (sim_eeprom.bin by
+// default, see --eeprom) so settings survive a simulated restart.
+class EEPROMClass
+{
+private:
+    uint8_t *data = nullptr;
+    size_t size = 0;
+    bool dirty = false;
+
+public:
+    constexpr EEPROMClass() {}
+
+    bool begin(size_t size);
+    void end();
+    bool commit();
+
+    uint8_t read(int address);
+    void write(int address, uint8_t val);
+
+    uint8_t *getDataPtr();
+    const uint8_t *getConstDataPtr() const { return data; }
+    uint16_t length() const { return size; }
+
+    uint8_t readByte(int address) { return read(address); }
+    size_t writeByte(int address, uint8_t value);
+
+    size_t readBytes(int address, void *value, size_t maxLen);
+    size_t writeBytes(int address, const void *value, size_t len);
+
+    String readString(int address);
+    size_t writeString(int address, const char *value);
+    size_t writeString(int address, String value) { return writeString(address, value.c_str()); }
+};
+
+extern EEPROMClass EEPROM;
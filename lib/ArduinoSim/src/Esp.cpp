@@ -0,0 +1,101 @@
+#include "Esp.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "simClock.h"
+
+#include <chrono>
+#include <cstdio>
+#include <malloc.h>
+#include <unistd.h>
+
+EspClass ESP;
+
+namespace
+{
+    // the simulated device has the heap of a classic ESP32 with WiFi running
+    const uint32_t SIM_HEAP_SIZE = 320 * 1024;
+    uint32_t minFreeHeap = SIM_HEAP_SIZE;
+
+    uint32_t heapInUse()
+    {
+        struct mallinfo2 info = mallinfo2();
+        return static_cast<uint32_t>(info.uordblks);
+    }
+}
+
+uint32_t EspClass::getCycleCount()
+{
+    auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                     std::chrono::steady_clock::now().time_since_epoch())
+                     .count();
+    return static_cast<uint32_t>(static_cast<uint64_t>(nanos) * 240 / 1000);
+}
+
+uint32_t EspClass::getHeapSize()
+{
+    return SIM_HEAP_SIZE;
+}
+
+uint32_t EspClass::getFreeHeap()
+{
+    uint32_t used = heapInUse();
+    uint32_t freeHeap = used < SIM_HEAP_SIZE ? SIM_HEAP_SIZE - used : 0;
+    if (freeHeap < minFreeHeap)
+    {
+        minFreeHeap = freeHeap;
+    }
+    return freeHeap;
+}
+
+uint32_t EspClass::getMinFreeHeap()
+{
+    getFreeHeap();
+    return minFreeHeap;
+}
+
+uint32_t EspClass::getMaxAllocHeap()
+{
+    return getFreeHeap();
+}
+
+void EspClass::restart()
+{
+    esp_restart();
+}
+
+// A restart re-executes the simulator so every global is constructed
+// again and settings are reloaded from the EEPROM file, as on a device.
+[[noreturn]] void esp_restart()
+{
+    fflush(stdout);
+    execl("/proc/self/exe", "/proc/self/exe", static_cast<char *>(nullptr));
+
+    perror("esp_restart: re-exec failed");
+    _exit(1);
+}
+
+//
+// Light sleep simply advances the simulated clock
+//
+
+namespace
+{
+    uint64_t sleepTimerMicros = 0;
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+    sleepTimerMicros = time_in_us;
+    return ESP_OK;
+}
+
+esp_err_t esp_light_sleep_start()
+{
+    sim::Clock::sleepMicros(sleepTimerMicros);
+    return ESP_OK;
+}
+
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause()
+{
+    return ESP_SLEEP_WAKEUP_TIMER;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include "WString.h"
+
+// Chip information reported by the simulator. Heap figures come from
+// the host allocator, so only deltas are meaningful.
+class EspClass
+{
+public:
+    uint32_t getHeapSize();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getMaxAllocHeap();
+
+    uint32_t getPsramSize() { return 0; }
+    uint32_t getFreePsram() { return 0; }
+
+    const char *getChipModel() { return "ESP32-SIM"; }
+    uint8_t getChipRevision() { return 3; }
+    uint32_t getCpuFreqMHz() { return 240; }
+
+    // a 240 MHz cycle counter driven by the host's real (unscaled) clock,
+    // so profiling measures what the code actually costs on this machine
+    uint32_t getCycleCount();
+    uint8_t getChipCores() { return 2; }
+    const char *getSdkVersion() { return "native-sim"; }
+
+    uint32_t getFlashChipSize() { return 4 * 1024 * 1024; }
+    uint32_t getFlashChipSpeed() { return 40000000; }
+
+    uint32_t getSketchSize() { return 0; }
+    String getSketchMD5() { return String("00000000000000000000000000000000"); }
+
+    [[noreturn]] void restart();
+};
+
+extern EspClass ESP;
+
+inline bool psramFound() { return false; }
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Stream.h"
+
+// Serial writes to the process' stdout. It has no state so it is
+// usable from the constructors of other globals (e.g. Logger).
+class HardwareSerial : public Stream
+{
+public:
+    constexpr HardwareSerial() {}
+
+    void begin(unsigned long baud) { (void)baud; }
+    void end() {}
+
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    void flush() override;
+
+    size_t write(uint8_t c) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+
+    operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,65 @@
+#include "IPAddress.h"
+#include "Print.h"
+
+#include <cstdio>
+
+const IPAddress INADDR_NONE(0, 0, 0, 0);
+
+IPAddress::IPAddress()
+{
+    _address.dword = 0;
+}
+
+IPAddress::IPAddress(uint8_t first_octet, uint8_t second_octet, uint8_t third_octet, uint8_t fourth_octet)
+{
+    _address.bytes[0] = first_octet;
+    _address.bytes[1] = second_octet;
+    _address.bytes[2] = third_octet;
+    _address.bytes[3] = fourth_octet;
+}
+
+IPAddress::IPAddress(uint32_t address)
+{
+    _address.dword = address;
+}
+
+IPAddress::IPAddress(const uint8_t *address)
+{
+    memcpy(_address.bytes, address, sizeof(_address.bytes));
+}
+
+bool IPAddress::operator==(const uint8_t *addr) const
+{
+    return memcmp(addr, _address.bytes, sizeof(_address.bytes)) == 0;
+}
+
+bool IPAddress::fromString(const char *address)
+{
+    unsigned int parts[4];
+    char trailing;
+    if (sscanf(address, "%u.%u.%u.%u%c", &parts[0], &parts[1], &parts[2], &parts[3], &trailing) != 4)
+    {
+        return false;
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        if (parts[i] > 255)
+        {
+            return false;
+        }
+        _address.bytes[i] = static_cast<uint8_t>(parts[i]);
+    }
+    return true;
+}
+
+size_t IPAddress::printTo(Print &p) const
+{
+    return p.print(toString());
+}
+
+String IPAddress::toString() const
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", _address.bytes[0], _address.bytes[1], _address.bytes[2], _address.bytes[3]);
+    return String(buf);
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+#include "WString.h"
+#include "Printable.h"
+
+class IPAddress : public Printable
+{
+private:
+    union
+    {
+        uint8_t bytes[4];
+        uint32_t dword;
+    } _address;
+
+public:
+    IPAddress();
+    IPAddress(uint8_t first_octet, uint8_t second_octet, uint8_t third_octet, uint8_t fourth_octet);
+    IPAddress(uint32_t address);
+    IPAddress(const uint8_t *address);
+
+    bool fromString(const char *address);
+    bool fromString(const String &address) { return fromString(address.c_str()); }
+
+    operator uint32_t() const { return _address.dword; }
+    bool operator==(const IPAddress &addr) const { return _address.dword == addr._address.dword; }
+    bool operator!=(const IPAddress &addr) const { return !(*this == addr); }
+    bool operator==(const uint8_t *addr) const;
+
+    uint8_t operator[](int index) const { return _address.bytes[index]; }
+    uint8_t &operator[](int index) { return _address.bytes[index]; }
+
+    uint8_t *raw_address() { return _address.bytes; }
+
+    size_t printTo(Print &p) const override;
+    String toString() const;
+};
+
+extern const IPAddress INADDR_NONE;
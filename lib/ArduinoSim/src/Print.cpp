@@ -0,0 +1,81 @@
+#include "Print.h"
+
+#include <cstdio>
+#include <vector>
+
+size_t Print::write(const uint8_t *buffer, size_t size)
+{
+    size_t n = 0;
+    while (size--)
+    {
+        if (!write(*buffer++))
+        {
+            break;
+        }
+        n++;
+    }
+    return n;
+}
+
+size_t Print::write(const char *str)
+{
+    return str ? write(reinterpret_cast<const uint8_t *>(str), strlen(str)) : 0;
+}
+
+size_t Print::write(const char *buffer, size_t size)
+{
+    return write(reinterpret_cast<const uint8_t *>(buffer), size);
+}
+
+size_t Print::printf(const char *format, ...)
+{
+    char loc_buf[64];
+    va_list arg;
+    va_start(arg, format);
+    int len = vsnprintf(loc_buf, sizeof(loc_buf), format, arg);
+    va_end(arg);
+
+    if (len < 0)
+    {
+        return 0;
+    }
+    if (len < static_cast<int>(sizeof(loc_buf)))
+    {
+        return write(loc_buf, len);
+    }
+
+    std::vector<char> temp(len + 1);
+    va_start(arg, format);
+    vsnprintf(temp.data(), temp.size(), format, arg);
+    va_end(arg);
+    return write(temp.data(), len);
+}
+
+size_t Print::print(const __FlashStringHelper *ifsh) { return print(reinterpret_cast<const char *>(ifsh)); }
+size_t Print::print(const String &s) { return write(s.c_str(), s.length()); }
+size_t Print::print(const char str[]) { return write(str); }
+size_t Print::print(char c) { return write(static_cast<uint8_t>(c)); }
+size_t Print::print(unsigned char b, int base) { return print(String(b, base)); }
+size_t Print::print(int n, int base) { return print(String(n, base)); }
+size_t Print::print(unsigned int n, int base) { return print(String(n, base)); }
+size_t Print::print(long n, int base) { return print(String(n, base)); }
+size_t Print::print(unsigned long n, int base) { return print(String(n, base)); }
+size_t Print::print(long long n, int base) { return print(String(n, base)); }
+size_t Print::print(unsigned long long n, int base) { return print(String(n, base)); }
+size_t Print::print(double n, int digits) { return print(String(n, digits)); }
+size_t Print::print(const Printable &x) { return x.printTo(*this); }
+
+size_t Print::println(void) { return print("\r\n"); }
+size_t Print::println(const __FlashStringHelper *ifsh) { return print(ifsh) + println(); }
+size_t Print::println(const String &s) { return print(s) + println(); }
+size_t Print::println(const char str[]) { return print(str) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(unsigned char b, int base) { return print(b, base) + println(); }
+size_t Print::println(int n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base) { return print(n, base) + println(); }
+size_t Print::println(long n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base) { return print(n, base) + println(); }
+size_t Print::println(long long n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned long long n, int base) { return print(n, base) + println(); }
+size_t Print::println(double n, int digits) { return print(n, digits) + println(); }
+size_t Print::println(const Printable &x) { return print(x) + println(); }
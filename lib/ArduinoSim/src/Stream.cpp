@@ -0,0 +1,45 @@
+#include "Stream.h"
+#include "esp32-hal.h"
+
+int Stream::timedRead()
+{
+    unsigned long startMillis = millis();
+    do
+    {
+        int c = read();
+        if (c >= 0)
+        {
+            return c;
+        }
+        yield();
+    } while (millis() - startMillis < _timeout);
+    return -1;
+}
+
+size_t Stream::readBytes(char *buffer, size_t length)
+{
+    size_t count = 0;
+    while (count < length)
+    {
+        int c = timedRead();
+        if (c < 0)
+        {
+            break;
+        }
+        *buffer++ = static_cast<char>(c);
+        count++;
+    }
+    return count;
+}
+
+String Stream::readString()
+{
+    String ret;
+    int c = timedRead();
+    while (c >= 0)
+    {
+        ret += static_cast<char>(c);
+        c = timedRead();
+    }
+    return ret;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "Print.h"
+
+class Stream : public Print
+{
+protected:
+    unsigned long _timeout = 1000;
+
+    int timedRead();
+
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    void setTimeout(unsigned long timeout) { _timeout = timeout; }
+    unsigned long getTimeout() const { return _timeout; }
+
+    virtual size_t readBytes(char *buffer, size_t length);
+    virtual size_t readBytes(uint8_t *buffer, size_t length)
+    {
+        return readBytes(reinterpret_cast<char *>(buffer), length);
+    }
+    String readString();
+};
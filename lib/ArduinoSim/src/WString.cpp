@@ -0,0 +1,399 @@
+#include "WString.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+
+namespace
+{
+    std::string integerToString(unsigned long long value, bool negative, unsigned char base)
+    {
+        if (base < 2 || base > 36)
+        {
+            base = 10;
+        }
+
+        char digits[66];
+        int pos = sizeof(digits) - 1;
+        digits[pos] = '\0';
+
+        do
+        {
+            int digit = value % base;
+            digits[--pos] = digit < 10 ? '0' + digit : 'a' + digit - 10;
+            value /= base;
+        } while (value != 0);
+
+        if (negative)
+        {
+            digits[--pos] = '-';
+        }
+        return std::string(&digits[pos]);
+    }
+
+    std::string signedToString(long long value, unsigned char base)
+    {
+        // like the arduino core, only base 10 shows a sign
+        if (value < 0 && base == 10)
+        {
+            return integerToString(0ULL - static_cast<unsigned long long>(value), true, base);
+        }
+        return integerToString(static_cast<unsigned long long>(value), false, base);
+    }
+
+    std::string floatToString(double value, unsigned int decimalPlaces)
+    {
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%.*f", decimalPlaces, value);
+        return std::string(buf);
+    }
+}
+
+String::String(const char *cstr) : buffer(cstr ? cstr : "") {}
+String::String(const char *cstr, unsigned int length) : buffer(cstr ? std::string(cstr, length) : std::string()) {}
+String::String(const uint8_t *cstr, unsigned int length) : String(reinterpret_cast<const char *>(cstr), length) {}
+String::String(const __FlashStringHelper *str) : String(reinterpret_cast<const char *>(str)) {}
+String::String(char c) : buffer(1, c) {}
+String::String(unsigned char value, unsigned char base) : buffer(integerToString(value, false, base)) {}
+String::String(int value, unsigned char base) : buffer(signedToString(value, base)) {}
+String::String(unsigned int value, unsigned char base) : buffer(integerToString(value, false, base)) {}
+String::String(long value, unsigned char base) : buffer(signedToString(value, base)) {}
+String::String(unsigned long value, unsigned char base) : buffer(integerToString(value, false, base)) {}
+String::String(long long value, unsigned char base) : buffer(signedToString(value, base)) {}
+String::String(unsigned long long value, unsigned char base) : buffer(integerToString(value, false, base)) {}
+String::String(float value, unsigned int decimalPlaces) : buffer(floatToString(value, decimalPlaces)) {}
+String::String(double value, unsigned int decimalPlaces) : buffer(floatToString(value, decimalPlaces)) {}
+
+bool String::reserve(unsigned int size)
+{
+    buffer.reserve(size);
+    return true;
+}
+
+String &String::operator=(const char *cstr)
+{
+    if (cstr)
+    {
+        buffer.assign(cstr);
+    }
+    else
+    {
+        buffer.clear();
+    }
+    return *this;
+}
+
+String &String::operator=(const __FlashStringHelper *str)
+{
+    return *this = reinterpret_cast<const char *>(str);
+}
+
+bool String::concat(const String &str)
+{
+    buffer.append(str.buffer);
+    return true;
+}
+
+bool String::concat(const char *cstr)
+{
+    if (!cstr)
+    {
+        return false;
+    }
+    buffer.append(cstr);
+    return true;
+}
+
+bool String::concat(const char *cstr, unsigned int length)
+{
+    if (!cstr)
+    {
+        return false;
+    }
+    buffer.append(cstr, length);
+    return true;
+}
+
+bool String::concat(const uint8_t *cstr, unsigned int length)
+{
+    return concat(reinterpret_cast<const char *>(cstr), length);
+}
+
+bool String::concat(char c)
+{
+    buffer.push_back(c);
+    return true;
+}
+
+bool String::concat(unsigned char num) { return concat(String(num)); }
+bool String::concat(int num) { return concat(String(num)); }
+bool String::concat(unsigned int num) { return concat(String(num)); }
+bool String::concat(long num) { return concat(String(num)); }
+bool String::concat(unsigned long num) { return concat(String(num)); }
+bool String::concat(long long num) { return concat(String(num)); }
+bool String::concat(unsigned long long num) { return concat(String(num)); }
+bool String::concat(float num) { return concat(String(num)); }
+bool String::concat(double num) { return concat(String(num)); }
+bool String::concat(const __FlashStringHelper *str) { return concat(reinterpret_cast<const char *>(str)); }
+
+int String::compareTo(const String &s) const
+{
+    return buffer.compare(s.buffer);
+}
+
+bool String::equals(const String &s) const
+{
+    return buffer == s.buffer;
+}
+
+bool String::equals(const char *cstr) const
+{
+    return buffer == (cstr ? cstr : "");
+}
+
+bool String::equalsIgnoreCase(const String &s) const
+{
+    if (length() != s.length())
+    {
+        return false;
+    }
+    for (unsigned int i = 0; i < length(); i++)
+    {
+        if (tolower(buffer[i]) != tolower(s.buffer[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool String::startsWith(const String &prefix) const
+{
+    return startsWith(prefix, 0);
+}
+
+bool String::startsWith(const String &prefix, unsigned int offset) const
+{
+    if (offset + prefix.length() > length())
+    {
+        return false;
+    }
+    return buffer.compare(offset, prefix.length(), prefix.buffer) == 0;
+}
+
+bool String::endsWith(const String &suffix) const
+{
+    if (suffix.length() > length())
+    {
+        return false;
+    }
+    return buffer.compare(length() - suffix.length(), suffix.length(), suffix.buffer) == 0;
+}
+
+char String::charAt(unsigned int index) const
+{
+    return operator[](index);
+}
+
+void String::setCharAt(unsigned int index, char c)
+{
+    if (index < length())
+    {
+        buffer[index] = c;
+    }
+}
+
+char String::operator[](unsigned int index) const
+{
+    return index < length() ? buffer[index] : 0;
+}
+
+char &String::operator[](unsigned int index)
+{
+    static char dummy;
+    if (index >= length())
+    {
+        dummy = 0;
+        return dummy;
+    }
+    return buffer[index];
+}
+
+void String::getBytes(unsigned char *buf, unsigned int bufsize, unsigned int index) const
+{
+    if (!bufsize || !buf)
+    {
+        return;
+    }
+    if (index >= length())
+    {
+        buf[0] = 0;
+        return;
+    }
+    unsigned int n = std::min(bufsize - 1, length() - index);
+    memcpy(buf, buffer.data() + index, n);
+    buf[n] = 0;
+}
+
+void String::toCharArray(char *buf, unsigned int bufsize, unsigned int index) const
+{
+    getBytes(reinterpret_cast<unsigned char *>(buf), bufsize, index);
+}
+
+int String::indexOf(char ch) const
+{
+    return indexOf(ch, 0);
+}
+
+int String::indexOf(char ch, unsigned int fromIndex) const
+{
+    size_t pos = buffer.find(ch, fromIndex);
+    return pos == std::string::npos ? -1 : static_cast<int>(pos);
+}
+
+int String::indexOf(const String &str) const
+{
+    return indexOf(str, 0);
+}
+
+int String::indexOf(const String &str, unsigned int fromIndex) const
+{
+    size_t pos = buffer.find(str.buffer, fromIndex);
+    return pos == std::string::npos ? -1 : static_cast<int>(pos);
+}
+
+int String::lastIndexOf(char ch) const
+{
+    size_t pos = buffer.rfind(ch);
+    return pos == std::string::npos ? -1 : static_cast<int>(pos);
+}
+
+int String::lastIndexOf(const String &str) const
+{
+    size_t pos = buffer.rfind(str.buffer);
+    return pos == std::string::npos ? -1 : static_cast<int>(pos);
+}
+
+String String::substring(unsigned int beginIndex) const
+{
+    return substring(beginIndex, length());
+}
+
+String String::substring(unsigned int beginIndex, unsigned int endIndex) const
+{
+    if (beginIndex > endIndex)
+    {
+        std::swap(beginIndex, endIndex);
+    }
+    if (beginIndex >= length())
+    {
+        return String();
+    }
+    endIndex = std::min(endIndex, length());
+    return String(buffer.data() + beginIndex, endIndex - beginIndex);
+}
+
+void String::replace(char find, char replace)
+{
+    std::replace(buffer.begin(), buffer.end(), find, replace);
+}
+
+void String::replace(const String &find, const String &replace)
+{
+    if (find.isEmpty())
+    {
+        return;
+    }
+    size_t pos = 0;
+    while ((pos = buffer.find(find.buffer, pos)) != std::string::npos)
+    {
+        buffer.replace(pos, find.length(), replace.buffer);
+        pos += replace.length();
+    }
+}
+
+void String::remove(unsigned int index)
+{
+    remove(index, static_cast<unsigned int>(-1));
+}
+
+void String::remove(unsigned int index, unsigned int count)
+{
+    if (index < length())
+    {
+        buffer.erase(index, count);
+    }
+}
+
+void String::toLowerCase()
+{
+    for (char &c : buffer)
+    {
+        c = tolower(c);
+    }
+}
+
+void String::toUpperCase()
+{
+    for (char &c : buffer)
+    {
+        c = toupper(c);
+    }
+}
+
+void String::trim()
+{
+    size_t first = buffer.find_first_not_of(" \t\r\n\f\v");
+    if (first == std::string::npos)
+    {
+        buffer.clear();
+        return;
+    }
+    size_t last = buffer.find_last_not_of(" \t\r\n\f\v");
+    buffer = buffer.substr(first, last - first + 1);
+}
+
+long String::toInt() const
+{
+    return atol(buffer.c_str());
+}
+
+float String::toFloat() const
+{
+    return static_cast<float>(toDouble());
+}
+
+double String::toDouble() const
+{
+    return atof(buffer.c_str());
+}
+
+String operator+(const String &lhs, const String &rhs)
+{
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+String operator+(const String &lhs, const char *rhs)
+{
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+String operator+(const char *lhs, const String &rhs)
+{
+    String result(lhs);
+    result.concat(rhs);
+    return result;
+}
+
+String operator+(const String &lhs, char rhs) { return lhs + String(rhs); }
+String operator+(const String &lhs, int rhs) { return lhs + String(rhs); }
+String operator+(const String &lhs, unsigned int rhs) { return lhs + String(rhs); }
+String operator+(const String &lhs, long rhs) { return lhs + String(rhs); }
+String operator+(const String &lhs, unsigned long rhs) { return lhs + String(rhs); }
+String operator+(const String &lhs, float rhs) { return lhs + String(rhs); }
+String operator+(const String &lhs, double rhs) { return lhs + String(rhs); }
@@ -0,0 +1,307 @@
+#include "WiFi.h"
+#include "simClock.h"
+#include "simConfig.h"
+
+#include <algorithm>
+#include <netdb.h>
+#include <arpa/inet.h>
+
+WiFiClass WiFi;
+
+namespace
+{
+    void pollWiFi()
+    {
+        WiFi.poll();
+    }
+
+    uint64_t secondsToMicros(uint32_t seconds)
+    {
+        return seconds * 1000000ULL;
+    }
+}
+
+WiFiClass::WiFiClass()
+{
+    sim::addPollHandler(pollWiFi);
+    queue(SYSTEM_EVENT_WIFI_READY);
+}
+
+void WiFiClass::queue(WiFiEvent_t event, uint64_t delayMicros)
+{
+    pending.push_back({sim::Clock::nowMicros() + delayMicros, event});
+}
+
+wifi_event_id_t WiFiClass::onEvent(WiFiEventFuncCb cbEvent)
+{
+    handlers.push_back(cbEvent);
+    return handlers.size();
+}
+
+void WiFiClass::poll()
+{
+    uint64_t now = sim::Clock::nowMicros();
+    const sim::Config &config = sim::config();
+
+    // scheduled outage
+    if (linkUp && config.wifiDropEverySecs != 0 && nextDrop != 0 && now >= nextDrop)
+    {
+        outageUntil = now + secondsToMicros(config.wifiOutageSecs);
+        dropLink(WL_CONNECTION_LOST);
+    }
+
+    // association completes (or fails if we are inside an outage)
+    if (connectDue != 0 && now >= connectDue)
+    {
+        connectDue = 0;
+        if (now < outageUntil)
+        {
+            staStatus = WL_NO_SSID_AVAIL;
+            queue(SYSTEM_EVENT_STA_DISCONNECTED);
+        }
+        else
+        {
+            linkUp = true;
+            staStatus = WL_CONNECTED;
+            if (config.wifiDropEverySecs != 0)
+            {
+                nextDrop = now + secondsToMicros(config.wifiDropEverySecs);
+            }
+            queue(SYSTEM_EVENT_STA_CONNECTED);
+            if (++associations > config.wifiDhcpFails)
+            {
+                queue(SYSTEM_EVENT_STA_GOT_IP, 100000);
+            }
+        }
+    }
+
+    // the driver's own auto reconnect, once the outage has passed
+    if (!linkUp && connectDue == 0 && autoReconnect && staStarted && outageUntil != 0 && now >= outageUntil)
+    {
+        outageUntil = 0;
+        startAssociation();
+    }
+
+    if (pending.empty())
+    {
+        return;
+    }
+
+    // deliver due events in order; handlers may queue more events
+    std::vector<PendingEvent> due;
+    auto firstNotDue = std::stable_partition(pending.begin(), pending.end(),
+                                             [now](const PendingEvent &e) { return e.due <= now; });
+    due.assign(pending.begin(), firstNotDue);
+    pending.erase(pending.begin(), firstNotDue);
+
+    for (const PendingEvent &e : due)
+    {
+        for (const WiFiEventFuncCb &handler : handlers)
+        {
+            handler(e.event);
+        }
+    }
+}
+
+void WiFiClass::startAssociation()
+{
+    staStatus = WL_DISCONNECTED;
+    connectDue = sim::Clock::nowMicros() + sim::config().wifiConnectMillis * 1000ULL;
+}
+
+void WiFiClass::dropLink(wl_status_t reason)
+{
+    bool wasUp = linkUp;
+    linkUp = false;
+    linkGeneration++;
+    nextDrop = 0;
+    staStatus = reason;
+
+    if (wasUp)
+    {
+        queue(SYSTEM_EVENT_STA_LOST_IP);
+    }
+    queue(SYSTEM_EVENT_STA_DISCONNECTED);
+}
+
+bool WiFiClass::mode(wifi_mode_t m)
+{
+    bool wantSta = m == WIFI_MODE_STA || m == WIFI_MODE_APSTA;
+    bool wantAp = m == WIFI_MODE_AP || m == WIFI_MODE_APSTA;
+    bool hadAp = wifiMode == WIFI_MODE_AP || wifiMode == WIFI_MODE_APSTA;
+
+    if (wantSta && !staStarted)
+    {
+        staStarted = true;
+        queue(SYSTEM_EVENT_STA_START);
+    }
+    else if (!wantSta && staStarted)
+    {
+        if (linkUp)
+        {
+            dropLink(WL_DISCONNECTED);
+        }
+        staStarted = false;
+        connectDue = 0;
+        queue(SYSTEM_EVENT_STA_STOP);
+    }
+
+    if (hadAp && !wantAp)
+    {
+        queue(SYSTEM_EVENT_AP_STOP);
+    }
+
+    wifiMode = m;
+    return true;
+}
+
+wl_status_t WiFiClass::begin(const char *newSsid, const char *passphrase, int32_t channel, const uint8_t *bssid, bool connect)
+{
+    (void)passphrase;
+    (void)channel;
+    (void)bssid;
+
+    if (!newSsid || !*newSsid)
+    {
+        staStatus = WL_CONNECT_FAILED;
+        return staStatus;
+    }
+
+    if (wifiMode == WIFI_MODE_NULL || wifiMode == WIFI_MODE_AP)
+    {
+        mode(wifiMode == WIFI_MODE_AP ? WIFI_MODE_APSTA : WIFI_MODE_STA);
+    }
+
+    ssid = newSsid;
+    if (linkUp)
+    {
+        dropLink(WL_DISCONNECTED);
+    }
+    if (connect)
+    {
+        startAssociation();
+    }
+    return staStatus;
+}
+
+bool WiFiClass::reconnect()
+{
+    if (!staStarted || ssid.isEmpty())
+    {
+        return false;
+    }
+    if (linkUp)
+    {
+        dropLink(WL_DISCONNECTED);
+    }
+    startAssociation();
+    return true;
+}
+
+bool WiFiClass::disconnect(bool wifioff, bool eraseap)
+{
+    (void)eraseap;
+
+    connectDue = 0;
+    if (linkUp)
+    {
+        dropLink(WL_DISCONNECTED);
+    }
+    staStatus = WL_DISCONNECTED;
+
+    if (wifioff)
+    {
+        mode(WIFI_MODE_NULL);
+    }
+    return true;
+}
+
+bool WiFiClass::setAutoReconnect(bool value)
+{
+    autoReconnect = value;
+    return true;
+}
+
+bool WiFiClass::setHostname(const char *name)
+{
+    hostname = name;
+    return true;
+}
+
+IPAddress WiFiClass::localIP() const
+{
+    return isConnected() ? IPAddress(127, 0, 0, 1) : IPAddress();
+}
+
+IPAddress WiFiClass::gatewayIP() const
+{
+    return isConnected() ? IPAddress(127, 0, 0, 1) : IPAddress();
+}
+
+IPAddress WiFiClass::subnetMask() const
+{
+    return isConnected() ? IPAddress(255, 0, 0, 0) : IPAddress();
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t dns_no) const
+{
+    (void)dns_no;
+    return isConnected() ? IPAddress(127, 0, 0, 53) : IPAddress();
+}
+
+bool WiFiClass::softAPConfig(IPAddress local_ip, IPAddress gateway, IPAddress subnet)
+{
+    (void)local_ip;
+    (void)gateway;
+    (void)subnet;
+    return true;
+}
+
+bool WiFiClass::softAP(const char *newSsid, const char *passphrase, int channel, int ssid_hidden, int max_connection)
+{
+    (void)passphrase;
+    (void)channel;
+    (void)ssid_hidden;
+    (void)max_connection;
+
+    apSsid = newSsid;
+    if (wifiMode != WIFI_MODE_AP && wifiMode != WIFI_MODE_APSTA)
+    {
+        wifiMode = staStarted ? WIFI_MODE_APSTA : WIFI_MODE_AP;
+        queue(SYSTEM_EVENT_AP_START);
+    }
+    return true;
+}
+
+bool WiFiClass::softAPdisconnect(bool wifioff)
+{
+    if (wifiMode == WIFI_MODE_AP || wifiMode == WIFI_MODE_APSTA)
+    {
+        queue(SYSTEM_EVENT_AP_STOP);
+        wifiMode = wifioff ? WIFI_MODE_NULL : (staStarted ? WIFI_MODE_STA : WIFI_MODE_NULL);
+    }
+    apSsid = "";
+    return true;
+}
+
+IPAddress WiFiClass::softAPIP() const
+{
+    return (wifiMode == WIFI_MODE_AP || wifiMode == WIFI_MODE_APSTA) ? IPAddress(4, 3, 2, 1) : IPAddress();
+}
+
+int WiFiClass::hostByName(const char *aHostname, IPAddress &aResult)
+{
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    struct addrinfo *result = nullptr;
+
+    if (getaddrinfo(aHostname, nullptr, &hints, &result) != 0 || !result)
+    {
+        return 0;
+    }
+
+    auto *addr = reinterpret_cast<struct sockaddr_in *>(result->ai_addr);
+    aResult = IPAddress(static_cast<uint32_t>(addr->sin_addr.s_addr));
+    freeaddrinfo(result);
+    return 1;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "Arduino.h"
+#include "IPAddress.h"
+#include "WiFiClient.h"
+#include "WiFiUdp.h"
+
+// ----------------------------------------------------------------
+// Simulated WiFi
+//
+// Station connects succeed after FAN_SIM_WIFI_CONNECT_MS of simulated
+// time and the link can be dropped periodically with
+// FAN_SIM_WIFI_DROP_EVERY / FAN_SIM_WIFI_OUTAGE. Events are queued and
+// delivered on the main thread from sim::poll(), like the arduino-esp32
+// event task would deliver them (but deterministically).
+// ----------------------------------------------------------------
+
+typedef enum
+{
+    SYSTEM_EVENT_WIFI_READY = 0,
+    SYSTEM_EVENT_SCAN_DONE,
+    SYSTEM_EVENT_STA_START,
+    SYSTEM_EVENT_STA_STOP,
+    SYSTEM_EVENT_STA_CONNECTED,
+    SYSTEM_EVENT_STA_DISCONNECTED,
+    SYSTEM_EVENT_STA_AUTHMODE_CHANGE,
+    SYSTEM_EVENT_STA_GOT_IP,
+    SYSTEM_EVENT_STA_LOST_IP,
+    SYSTEM_EVENT_STA_BSS_RSSI_LOW,
+    SYSTEM_EVENT_STA_WPS_ER_SUCCESS,
+    SYSTEM_EVENT_STA_WPS_ER_FAILED,
+    SYSTEM_EVENT_STA_WPS_ER_TIMEOUT,
+    SYSTEM_EVENT_STA_WPS_ER_PIN,
+    SYSTEM_EVENT_STA_WPS_ER_PBC_OVERLAP,
+    SYSTEM_EVENT_AP_START,
+    SYSTEM_EVENT_AP_STOP,
+    SYSTEM_EVENT_AP_STACONNECTED,
+    SYSTEM_EVENT_AP_STADISCONNECTED,
+    SYSTEM_EVENT_AP_STAIPASSIGNED,
+    SYSTEM_EVENT_AP_PROBEREQRECVED,
+    SYSTEM_EVENT_GOT_IP6,
+    SYSTEM_EVENT_ETH_START,
+    SYSTEM_EVENT_ETH_STOP,
+    SYSTEM_EVENT_ETH_CONNECTED,
+    SYSTEM_EVENT_ETH_DISCONNECTED,
+    SYSTEM_EVENT_ETH_GOT_IP,
+    SYSTEM_EVENT_MAX
+} system_event_id_t;
+
+typedef system_event_id_t WiFiEvent_t;
+typedef std::function<void(WiFiEvent_t event)> WiFiEventFuncCb;
+typedef size_t wifi_event_id_t;
+
+typedef enum
+{
+    WL_NO_SHIELD = 255,
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+typedef enum
+{
+    WIFI_MODE_NULL = 0,
+    WIFI_MODE_STA,
+    WIFI_MODE_AP,
+    WIFI_MODE_APSTA,
+    WIFI_MODE_MAX
+} wifi_mode_t;
+
+#define WIFI_OFF WIFI_MODE_NULL
+#define WIFI_STA WIFI_MODE_STA
+#define WIFI_AP WIFI_MODE_AP
+#define WIFI_AP_STA WIFI_MODE_APSTA
+
+class WiFiClass
+{
+private:
+    struct PendingEvent
+    {
+        uint64_t due;
+        WiFiEvent_t event;
+    };
+
+    std::vector<WiFiEventFuncCb> handlers;
+    std::vector<PendingEvent> pending;
+
+    wl_status_t staStatus = WL_IDLE_STATUS;
+    wifi_mode_t wifiMode = WIFI_MODE_NULL;
+    bool staStarted = false;
+    bool autoReconnect = true;
+    bool linkUp = false;
+    uint32_t linkGeneration = 0;
+    uint64_t connectDue = 0;
+    uint64_t nextDrop = 0;
+    uint64_t outageUntil = 0;
+    uint32_t associations = 0;          // counted for FAN_SIM_WIFI_DHCP_FAILS
+
+    String ssid;
+    String hostname = "esp32-sim";
+    String apSsid;
+
+    void queue(WiFiEvent_t event, uint64_t delayMicros = 0);
+    void startAssociation();
+    void dropLink(wl_status_t reason);
+
+public:
+    WiFiClass();
+
+    // delivers due events, called from sim::poll()
+    void poll();
+
+    // incremented every time the station link goes down; clients opened
+    // on an older link report themselves as disconnected
+    uint32_t getLinkGeneration() const { return linkGeneration; }
+
+    wifi_event_id_t onEvent(WiFiEventFuncCb cbEvent);
+
+    bool mode(wifi_mode_t m);
+    wifi_mode_t getMode() const { return wifiMode; }
+
+    wl_status_t begin(const char *ssid, const char *passphrase = nullptr, int32_t channel = 0, const uint8_t *bssid = nullptr, bool connect = true);
+    wl_status_t begin(const String &ssid, const String &passphrase = (const char *)nullptr, int32_t channel = 0, const uint8_t *bssid = nullptr, bool connect = true)
+    {
+        return begin(ssid.c_str(), passphrase.c_str(), channel, bssid, connect);
+    }
+
+    bool reconnect();
+    bool disconnect(bool wifioff = false, bool eraseap = false);
+    bool setAutoReconnect(bool value);
+    bool getAutoReconnect() const { return autoReconnect; }
+
+    wl_status_t status() const { return staStatus; }
+    bool isConnected() const { return staStatus == WL_CONNECTED; }
+
+    bool setHostname(const char *name);
+    const char *getHostname() const { return hostname.c_str(); }
+
+    String macAddress() const { return String("24:0A:C4:00:51:11"); }
+    String SSID() const { return ssid; }
+    String BSSIDstr() const { return String("02:00:00:00:00:01"); }
+    int8_t RSSI() const { return isConnected() ? -58 : 0; }
+    int32_t channel() const { return 6; }
+
+    IPAddress localIP() const;
+    IPAddress gatewayIP() const;
+    IPAddress subnetMask() const;
+    IPAddress dnsIP(uint8_t dns_no = 0) const;
+
+    bool softAPConfig(IPAddress local_ip, IPAddress gateway, IPAddress subnet);
+    bool softAP(const char *ssid, const char *passphrase = nullptr, int channel = 1, int ssid_hidden = 0, int max_connection = 4);
+    bool softAPdisconnect(bool wifioff = false);
+    IPAddress softAPIP() const;
+    String softAPmacAddress() const { return String("24:0A:C4:00:51:12"); }
+    String softAPSSID() const { return apSsid; }
+
+    int hostByName(const char *aHostname, IPAddress &aResult);
+};
+
+extern WiFiClass WiFi;
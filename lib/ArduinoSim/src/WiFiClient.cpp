@@ -0,0 +1,231 @@
+#include "WiFiClient.h"
+#include "WiFi.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+WiFiClient::WiFiClient(int socketFd)
+    : fd(socketFd), linkGeneration(WiFi.getLinkGeneration())
+{
+}
+
+WiFiClient::~WiFiClient()
+{
+    stop();
+}
+
+WiFiClient &WiFiClient::operator=(WiFiClient &&other)
+{
+    if (this != &other)
+    {
+        stop();
+        fd = other.fd;
+        linkGeneration = other.linkGeneration;
+        timeoutMillis = other.timeoutMillis;
+        other.fd = -1;
+    }
+    return *this;
+}
+
+bool WiFiClient::linkLost() const
+{
+    return WiFi.getLinkGeneration() != linkGeneration || !WiFi.isConnected();
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port)
+{
+    return connect(ip, port, timeoutMillis);
+}
+
+int WiFiClient::connect(const char *host, uint16_t port)
+{
+    return connect(host, port, timeoutMillis);
+}
+
+int WiFiClient::connect(const char *host, uint16_t port, int32_t timeout)
+{
+    IPAddress ip;
+    if (!WiFi.hostByName(host, ip))
+    {
+        return 0;
+    }
+    return connect(ip, port, timeout);
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port, int32_t timeout)
+{
+    stop();
+
+    if (!WiFi.isConnected())
+    {
+        return 0;
+    }
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = static_cast<uint32_t>(ip);
+
+    // non-blocking connect bounded by the timeout, like the esp32 client
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    int res = ::connect(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+    if (res < 0 && errno != EINPROGRESS)
+    {
+        stop();
+        return 0;
+    }
+
+    if (res < 0)
+    {
+        struct pollfd pfd = {fd, POLLOUT, 0};
+        int error = 0;
+        socklen_t len = sizeof(error);
+        if (::poll(&pfd, 1, timeout) <= 0 || getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error != 0)
+        {
+            stop();
+            return 0;
+        }
+    }
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    linkGeneration = WiFi.getLinkGeneration();
+    return 1;
+}
+
+size_t WiFiClient::write(uint8_t data)
+{
+    return write(&data, 1);
+}
+
+size_t WiFiClient::write(const uint8_t *buf, size_t size)
+{
+    if (!connected())
+    {
+        return 0;
+    }
+
+    size_t sent = 0;
+    while (sent < size)
+    {
+        ssize_t n = send(fd, buf + sent, size - sent, MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            struct pollfd pfd = {fd, POLLOUT, 0};
+            if (::poll(&pfd, 1, timeoutMillis) <= 0)
+            {
+                break;
+            }
+            continue;
+        }
+        if (n <= 0)
+        {
+            stop();
+            break;
+        }
+        sent += n;
+    }
+    return sent;
+}
+
+int WiFiClient::available()
+{
+    if (!connected())
+    {
+        return 0;
+    }
+
+    int count = 0;
+    if (ioctl(fd, FIONREAD, &count) < 0)
+    {
+        return 0;
+    }
+    return count;
+}
+
+int WiFiClient::read()
+{
+    uint8_t c;
+    return read(&c, 1) == 1 ? c : -1;
+}
+
+int WiFiClient::read(uint8_t *buf, size_t size)
+{
+    if (!connected())
+    {
+        return -1;
+    }
+
+    ssize_t n = recv(fd, buf, size, MSG_DONTWAIT);
+    if (n == 0)
+    {
+        stop();
+        return -1;
+    }
+    if (n < 0)
+    {
+        if (errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            stop();
+        }
+        return -1;
+    }
+    return static_cast<int>(n);
+}
+
+int WiFiClient::peek()
+{
+    if (!connected())
+    {
+        return -1;
+    }
+
+    uint8_t c;
+    return recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 1 ? c : -1;
+}
+
+void WiFiClient::stop()
+{
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+}
+
+uint8_t WiFiClient::connected()
+{
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    if (linkLost())
+    {
+        stop();
+        return 0;
+    }
+
+    // detect an orderly shutdown by the peer
+    uint8_t c;
+    ssize_t n = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK))
+    {
+        stop();
+        return 0;
+    }
+    return 1;
+}
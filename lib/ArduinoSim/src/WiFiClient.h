@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Arduino.h"
+#include "Client.h"
+
+// TCP client over a host socket. Connections opened before a simulated
+// WiFi drop report themselves as disconnected afterwards.
+class WiFiClient : public Client
+{
+private:
+    int fd = -1;
+    uint32_t linkGeneration = 0;
+    int timeoutMillis = 3000;
+
+    bool linkLost() const;
+
+public:
+    WiFiClient() {}
+    ~WiFiClient();
+
+    // takes over a socket that is already connected, as arduino-esp32's does
+    WiFiClient(int socketFd);
+
+    WiFiClient(const WiFiClient &) = delete;
+    WiFiClient &operator=(const WiFiClient &) = delete;
+    WiFiClient &operator=(WiFiClient &&other);
+
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char *host, uint16_t port) override;
+    int connect(IPAddress ip, uint16_t port, int32_t timeout);
+    int connect(const char *host, uint16_t port, int32_t timeout);
+
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t *buf, size_t size) override;
+    using Print::write;
+
+    int available() override;
+    int read() override;
+    int read(uint8_t *buf, size_t size) override;
+    int peek() override;
+    void flush() override {}
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override { return connected(); }
+
+    void setTimeout(uint32_t seconds) { timeoutMillis = seconds * 1000; }
+    int fileDescriptor() const { return fd; }
+};
@@ -0,0 +1,76 @@
+#include "WiFiUdp.h"
+#include "WiFi.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+WiFiUDP::~WiFiUDP()
+{
+    stop();
+}
+
+int WiFiUDP::beginPacket(IPAddress ip, uint16_t port)
+{
+    if (fd < 0)
+    {
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0)
+        {
+            return 0;
+        }
+    }
+
+    remoteIP = ip;
+    remotePort = port;
+    packet.clear();
+    return 1;
+}
+
+int WiFiUDP::beginPacket(const char *host, uint16_t port)
+{
+    IPAddress ip;
+    if (!WiFi.hostByName(host, ip))
+    {
+        return 0;
+    }
+    return beginPacket(ip, port);
+}
+
+int WiFiUDP::endPacket()
+{
+    if (fd < 0 || !WiFi.isConnected())
+    {
+        return 0;
+    }
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(remotePort);
+    addr.sin_addr.s_addr = static_cast<uint32_t>(remoteIP);
+
+    ssize_t n = sendto(fd, packet.data(), packet.size(), 0, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr));
+    packet.clear();
+    return n >= 0 ? 1 : 0;
+}
+
+size_t WiFiUDP::write(uint8_t data)
+{
+    packet.push_back(data);
+    return 1;
+}
+
+size_t WiFiUDP::write(const uint8_t *buffer, size_t size)
+{
+    packet.insert(packet.end(), buffer, buffer + size);
+    return size;
+}
+
+void WiFiUDP::stop()
+{
+    if (fd >= 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+}
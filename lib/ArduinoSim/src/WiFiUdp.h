@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+
+#include "Arduino.h"
+#include "IPAddress.h"
+
+// Send-only UDP, enough for the network debug printer.
+class WiFiUDP : public Print
+{
+private:
+    int fd = -1;
+    IPAddress remoteIP;
+    uint16_t remotePort = 0;
+    std::vector<uint8_t> packet;
+
+public:
+    WiFiUDP() {}
+    ~WiFiUDP();
+
+    int beginPacket(IPAddress ip, uint16_t port);
+    int beginPacket(const char *host, uint16_t port);
+    int endPacket();
+
+    size_t write(uint8_t data) override;
+    size_t write(const uint8_t *buffer, size_t size) override;
+    using Print::write;
+
+    void stop();
+};
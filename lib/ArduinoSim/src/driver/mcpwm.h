@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include "esp_err.h"
+
+// ----------------------------------------------------------------
+// MCPWM capture, the ESP-IDF 4.4 driver API used by arduino-esp32
+// 2.x. A capture channel timestamps the simulated fan's tacho edges
+// (see simFan.h) whichever pin it is given, with the 80 MHz APB clock
+// as the real capture timer, and calls its callback for each as the
+// interrupt would. Only capture is simulated, not PWM output.
+// ----------------------------------------------------------------
+
+typedef enum
+{
+    MCPWM_UNIT_0, MCPWM_UNIT_1,
+    MCPWM_UNIT_MAX
+} mcpwm_unit_t;
+
+typedef enum
+{
+    MCPWM_CAP_0 = 12, MCPWM_CAP_1, MCPWM_CAP_2
+} mcpwm_io_signals_t;
+
+typedef enum
+{
+    MCPWM_SELECT_CAP0, MCPWM_SELECT_CAP1, MCPWM_SELECT_CAP2,
+    MCPWM_CAP_MAX
+} mcpwm_capture_channel_id_t;
+
+typedef enum
+{
+    MCPWM_NEG_EDGE = 1,
+    MCPWM_POS_EDGE = 2,
+    MCPWM_BOTH_EDGE = 3
+} mcpwm_capture_on_edge_t;
+
+typedef struct
+{
+    mcpwm_capture_on_edge_t cap_edge;
+    uint32_t cap_value;     // capture timer ticks
+} cap_event_data_t;
+
+typedef bool (*cap_isr_cb_t)(mcpwm_unit_t mcpwm, mcpwm_capture_channel_id_t cap_channel,
+                             const cap_event_data_t *edata, void *user_data);
+
+typedef struct
+{
+    mcpwm_capture_on_edge_t cap_edge;
+    uint32_t cap_prescale;  // capture every this many edges
+    cap_isr_cb_t capture_cb;
+    void *user_data;
+} mcpwm_capture_config_t;
+
+esp_err_t mcpwm_gpio_init(mcpwm_unit_t mcpwm_num, mcpwm_io_signals_t io_signal, int gpio_num);
+esp_err_t mcpwm_capture_enable_channel(mcpwm_unit_t mcpwm_num, mcpwm_capture_channel_id_t cap_channel,
+                                       const mcpwm_capture_config_t *cap_conf);
+esp_err_t mcpwm_capture_disable_channel(mcpwm_unit_t mcpwm_num, mcpwm_capture_channel_id_t cap_channel);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+// LEDC PWM, arduino-esp32 2.x channel based API.
+// The simulated duty is kept per channel so the fan model can read it.
+
+#define LEDC_CHANNELS 16
+
+uint32_t ledcSetup(uint8_t channel, uint32_t freq, uint8_t resolution_bits);
+void ledcWrite(uint8_t channel, uint32_t duty);
+uint32_t ledcRead(uint8_t channel);
+uint32_t ledcReadFreq(uint8_t channel);
+void ledcAttachPin(uint8_t pin, uint8_t channel);
+void ledcDetachPin(uint8_t pin);
+
+namespace sim
+{
+    // duty of the channel driving pin, 0 to 1, or -1 if none is
+    double ledcDutyOnPin(uint8_t pin);
+}
@@ -0,0 +1,296 @@
+#include "Arduino.h"
+#include "esp_system.h"
+#include "simClock.h"
+#include "driver/ledc.h"
+
+#include <random>
+
+
+unsigned long millis()
+{
+    return static_cast<unsigned long>(sim::Clock::nowMicros() / 1000);
+}
+
+unsigned long micros()
+{
+    return static_cast<unsigned long>(sim::Clock::nowMicros());
+}
+
+void delay(uint32_t ms)
+{
+    sim::Clock::sleepMicros(ms * 1000ULL);
+    sim::poll();
+}
+
+void delayMicroseconds(uint32_t us)
+{
+    sim::Clock::sleepMicros(us);
+}
+
+void yield()
+{
+    sim::poll();
+}
+
+long map(long x, long in_min, long in_max, long out_min, long out_max)
+{
+    if (in_max == in_min)
+    {
+        return out_min;
+    }
+    return (x - in_min) * (out_max - out_min) / (in_max - in_min) + out_min;
+}
+
+namespace
+{
+    std::mt19937 &randomEngine()
+    {
+        static std::mt19937 engine{std::random_device{}()};
+        return engine;
+    }
+}
+
+uint32_t esp_random()
+{
+    return randomEngine()();
+}
+
+long random(long howbig)
+{
+    if (howbig <= 0)
+    {
+        return 0;
+    }
+    return esp_random() % howbig;
+}
+
+long random(long howsmall, long howbig)
+{
+    if (howsmall >= howbig)
+    {
+        return howsmall;
+    }
+    return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed)
+{
+    if (seed != 0)
+    {
+        randomEngine().seed(seed);
+    }
+}
+
+//
+// GPIO
+//
+
+namespace
+{
+    uint8_t pinModes[GPIO_NUM_MAX];
+    uint8_t pinLevels[GPIO_NUM_MAX];
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    if (pin < GPIO_NUM_MAX)
+    {
+        pinModes[pin] = mode;
+        if (mode == INPUT_PULLUP)
+        {
+            pinLevels[pin] = HIGH;
+        }
+    }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+    if (pin < GPIO_NUM_MAX)
+    {
+        pinLevels[pin] = val ? HIGH : LOW;
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    return pin < GPIO_NUM_MAX ? pinLevels[pin] : LOW;
+}
+
+//
+// LEDC
+//
+
+namespace
+{
+    struct LedcChannel
+    {
+        uint32_t freq;
+        uint8_t resolution;
+        uint32_t duty;
+        int pin = -1;
+
+        // a fade from duty to fadeDuty, set up and then started
+        uint32_t fadeDuty = 0;
+        uint64_t fadeMicros = 0;
+        uint64_t fadeStartMicros = 0;
+        bool fadeSet = false;
+        bool fading = false;
+    };
+
+    LedcChannel ledcChannels[LEDC_CHANNELS];
+    bool fadeInstalled = false;
+
+    // the duty now, part way along a fade
+    uint32_t dutyNow(const LedcChannel &c)
+    {
+        if (!c.fading)
+        {
+            return c.duty;
+        }
+        uint64_t elapsed = sim::Clock::nowMicros() - c.fadeStartMicros;
+        if (elapsed >= c.fadeMicros)
+        {
+            return c.fadeDuty;
+        }
+        return c.duty + ((int64_t)c.fadeDuty - c.duty) * (int64_t)elapsed / (int64_t)c.fadeMicros;
+    }
+
+    LedcChannel *fadeChannel(ledc_mode_t speed_mode, ledc_channel_t channel)
+    {
+        if (!fadeInstalled || speed_mode >= LEDC_SPEED_MODE_MAX || channel >= LEDC_CHANNEL_MAX)
+        {
+            return nullptr;
+        }
+        int index = speed_mode * LEDC_CHANNEL_MAX + channel;
+        return index < LEDC_CHANNELS ? &ledcChannels[index] : nullptr;
+    }
+}
+
+uint32_t ledcSetup(uint8_t channel, uint32_t freq, uint8_t resolution_bits)
+{
+    if (channel >= LEDC_CHANNELS || resolution_bits == 0 || resolution_bits > 20)
+    {
+        return 0;
+    }
+    ledcChannels[channel].freq = freq;
+    ledcChannels[channel].resolution = resolution_bits;
+    return freq;
+}
+
+void ledcWrite(uint8_t channel, uint32_t duty)
+{
+    if (channel < LEDC_CHANNELS)
+    {
+        ledcChannels[channel].duty = duty;
+        ledcChannels[channel].fading = false;
+    }
+}
+
+uint32_t ledcRead(uint8_t channel)
+{
+    return channel < LEDC_CHANNELS ? dutyNow(ledcChannels[channel]) : 0;
+}
+
+uint32_t ledcReadFreq(uint8_t channel)
+{
+    return channel < LEDC_CHANNELS ? ledcChannels[channel].freq : 0;
+}
+
+void ledcAttachPin(uint8_t pin, uint8_t channel)
+{
+    if (channel < LEDC_CHANNELS)
+    {
+        ledcChannels[channel].pin = pin;
+    }
+}
+
+void ledcDetachPin(uint8_t pin)
+{
+    for (LedcChannel &c : ledcChannels)
+    {
+        if (c.pin == pin)
+        {
+            c.pin = -1;
+        }
+    }
+}
+
+double sim::ledcDutyOnPin(uint8_t pin)
+{
+    for (const LedcChannel &c : ledcChannels)
+    {
+        if (c.pin == pin && c.resolution > 0)
+        {
+            return std::min(1.0, dutyNow(c) / (double)(1UL << c.resolution));
+        }
+    }
+    return -1;
+}
+
+esp_err_t ledc_fade_func_install(int intr_alloc_flags)
+{
+    (void)intr_alloc_flags;
+    if (fadeInstalled)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    fadeInstalled = true;
+    return ESP_OK;
+}
+
+void ledc_fade_func_uninstall()
+{
+    fadeInstalled = false;
+}
+
+esp_err_t ledc_set_fade_with_time(ledc_mode_t speed_mode, ledc_channel_t channel, uint32_t target_duty, int max_fade_time_ms)
+{
+    LedcChannel *c = fadeChannel(speed_mode, channel);
+    if (c == nullptr || max_fade_time_ms < 0 || target_duty > (1UL << c->resolution))
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    c->duty = dutyNow(*c);
+    c->fading = false;
+    c->fadeDuty = target_duty;
+    c->fadeMicros = max_fade_time_ms * 1000ULL;
+    c->fadeSet = true;
+    return ESP_OK;
+}
+
+esp_err_t ledc_fade_start(ledc_mode_t speed_mode, ledc_channel_t channel, ledc_fade_mode_t fade_mode)
+{
+    LedcChannel *c = fadeChannel(speed_mode, channel);
+    if (c == nullptr || !c->fadeSet)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+    c->fadeSet = false;
+    c->fadeStartMicros = sim::Clock::nowMicros();
+    c->fading = c->fadeMicros > 0;
+    if (!c->fading)
+    {
+        c->duty = c->fadeDuty;
+    }
+    if (fade_mode == LEDC_FADE_WAIT_DONE && c->fading)
+    {
+        sim::Clock::sleepMicros(c->fadeMicros);
+    }
+    return ESP_OK;
+}
+
+uint32_t ledc_get_duty(ledc_mode_t speed_mode, ledc_channel_t channel)
+{
+    LedcChannel *c = fadeChannel(speed_mode, channel);
+    return c != nullptr ? dutyNow(*c) : 0;
+}
+
+//
+// Chip temperature, a slow drift around 50C
+//
+
+float temperatureRead()
+{
+    double hours = sim::Clock::nowMicros() / 3600e6;
+    return static_cast<float>(50.0 + 5.0 * sin(hours));
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+
+// CRC-32 (IEEE 802.3, as zlib), the same result as the ROM function.
+// Bit at a time, the device uses a table in ROM.
+inline uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--)
+    {
+        crc ^= *buf++;
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include "esp_err.h"
+
+typedef enum
+{
+    ESP_SLEEP_WAKEUP_UNDEFINED,
+    ESP_SLEEP_WAKEUP_TIMER = 4,
+    ESP_SLEEP_WAKEUP_GPIO = 7,
+    ESP_SLEEP_WAKEUP_WIFI = 10,
+} esp_sleep_wakeup_cause_t;
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us);
+esp_err_t esp_light_sleep_start();
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause();
+inline esp_err_t esp_sleep_enable_wifi_wakeup() { return ESP_OK; }
+inline esp_err_t esp_sleep_disable_wifi_wakeup() { return ESP_OK; }
+inline esp_err_t esp_sleep_enable_gpio_wakeup() { return ESP_OK; }
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <cstdint>
+#include "esp_err.h"
+
+// seeded differently for every run, like the hardware RNG on each device
+uint32_t esp_random();
+
+[[noreturn]] void esp_restart();
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <cstdint>
+#include "simClock.h"
+
+// microseconds since boot, read from the simulated clock
+inline int64_t esp_timer_get_time()
+{
+    return static_cast<int64_t>(sim::Clock::nowMicros());
+}
@@ -0,0 +1,128 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "simClock.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+struct SimTask
+{
+    std::mutex mutex;
+    std::condition_variable notified;
+    uint32_t notifications = 0;
+};
+
+struct SimSemaphore
+{
+    std::timed_mutex mutex;
+};
+
+namespace
+{
+    // the task the calling thread is running, the main loop gets one on first use
+    thread_local SimTask *currentTask = nullptr;
+
+    SimTask *thisTask()
+    {
+        if (currentTask == nullptr)
+        {
+            currentTask = new SimTask();
+        }
+        return currentTask;
+    }
+
+    // real time to wait for a number of simulated milliseconds
+    std::chrono::microseconds realWait(TickType_t ticks)
+    {
+        return std::chrono::microseconds(static_cast<uint64_t>(ticks * 1000.0 / sim::Clock::getSpeed()));
+    }
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char *, uint32_t, void *parameters,
+                       UBaseType_t, TaskHandle_t *createdTask)
+{
+    SimTask *task = new SimTask();
+    if (createdTask)
+    {
+        *createdTask = task;
+    }
+
+    std::thread([function, parameters, task]() {
+        currentTask = task;
+        function(parameters);
+    }).detach();
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stackDepth, void *parameters,
+                                   UBaseType_t priority, TaskHandle_t *createdTask, BaseType_t)
+{
+    return xTaskCreate(function, name, stackDepth, parameters, priority, createdTask);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    sim::Clock::sleepMicros(ticks * 1000ULL);
+}
+
+TickType_t xTaskGetTickCount()
+{
+    return static_cast<TickType_t>(sim::Clock::nowMicros() / 1000);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notifications++;
+    }
+    task->notified.notify_one();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait)
+{
+    SimTask *task = thisTask();
+    std::unique_lock<std::mutex> lock(task->mutex);
+
+    auto pending = [task]() { return task->notifications > 0; };
+    if (ticksToWait == portMAX_DELAY)
+    {
+        task->notified.wait(lock, pending);
+    }
+    else
+    {
+        task->notified.wait_for(lock, realWait(ticksToWait), pending);
+    }
+
+    uint32_t count = task->notifications;
+    if (count > 0)
+    {
+        task->notifications = clearCountOnExit ? 0 : count - 1;
+    }
+    return count;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    return new SimSemaphore();
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait)
+{
+    if (ticksToWait == portMAX_DELAY)
+    {
+        semaphore->mutex.lock();
+        return pdTRUE;
+    }
+    return semaphore->mutex.try_lock_for(realWait(ticksToWait)) ? pdTRUE : pdFALSE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    semaphore->mutex.unlock();
+    return pdTRUE;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+
+// ----------------------------------------------------------------
+// FreeRTOS for the native build
+//
+// Just what the firmware uses: tasks are host threads, mutexes are
+// std::mutex and task notifications a counter and a condition
+// variable. Ticks are simulated milliseconds (configTICK_RATE_HZ is
+// 1000 on the ESP32), so timeouts follow the simulated clock.
+// ----------------------------------------------------------------
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdPASS pdTRUE
+#define pdFAIL pdFALSE
+
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portTICK_PERIOD_MS 1
+
+#define tskIDLE_PRIORITY 0
+#define tskNO_AFFINITY 0x7fffffff
+
+// critical sections, shared with (simulated) interrupt handlers
+typedef std::mutex portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) (mux)->lock()
+#define portEXIT_CRITICAL(mux) (mux)->unlock()
+#define portENTER_CRITICAL_ISR(mux) (mux)->lock()
+#define portEXIT_CRITICAL_ISR(mux) (mux)->unlock()
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "FreeRTOS.h"
+
+struct SimSemaphore;
+typedef SimSemaphore *SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticksToWait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
@@ -0,0 +1,48 @@
+#include "lwip/dns.h"
+#include "lwip/tcpip.h"
+
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <mutex>
+#include <thread>
+
+namespace
+{
+    // lwIP has the one tcpip thread, so its callbacks never overlap
+    std::mutex tcpipMutex;
+}
+
+err_t tcpip_callback(tcpip_callback_fn function, void *ctx)
+{
+    if (function == nullptr)
+    {
+        return ERR_ARG;
+    }
+
+    std::thread([function, ctx]() {
+        std::lock_guard<std::mutex> lock(tcpipMutex);
+        function(ctx);
+    }).detach();
+    return ERR_OK;
+}
+
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback, void *)
+{
+    if (hostname == nullptr || addr == nullptr || hostname[0] == '\0')
+    {
+        return ERR_ARG;
+    }
+
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    struct addrinfo *result = nullptr;
+    if (getaddrinfo(hostname, nullptr, &hints, &result) != 0 || result == nullptr)
+    {
+        return ERR_VAL;
+    }
+
+    addr->ip4.addr = reinterpret_cast<struct sockaddr_in *>(result->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(result);
+    return ERR_OK;
+}
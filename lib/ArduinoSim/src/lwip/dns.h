@@ -0,0 +1,14 @@
+#pragma once
+
+#include "err.h"
+#include "ip_addr.h"
+
+// ----------------------------------------------------------------
+// lwIP's DNS client, resolved with the host's resolver. Like lwIP it
+// must be called on the tcpip thread (see tcpip.h), an address or a
+// name in the host's cache answers straight away with ERR_OK.
+// ----------------------------------------------------------------
+
+typedef void (*dns_found_callback)(const char *name, const ip_addr_t *ipaddr, void *callback_arg);
+
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback found, void *callback_arg);
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+// IPv4 only, the accessors are lwIP's
+typedef struct
+{
+    uint32_t addr;      // network byte order
+} ip4_addr_t;
+
+typedef struct
+{
+    ip4_addr_t ip4;
+} ip_addr_t;
+
+#define ip_2_ip4(ipaddr) (&((ipaddr)->ip4))
+#define ip4_addr_get_u32(src_ipaddr) ((src_ipaddr)->addr)
@@ -0,0 +1,19 @@
+#pragma once
+
+// ----------------------------------------------------------------
+// lwIP's BSD sockets are the host's. lwip_connect() is the name
+// arduino-esp32 uses, clear of any class's own connect().
+// ----------------------------------------------------------------
+
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+inline int lwip_connect(int s, const struct sockaddr *name, socklen_t namelen)
+{
+    return ::connect(s, name, namelen);
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include "err.h"
+
+// ----------------------------------------------------------------
+// lwIP's tcpip thread. The function runs later on a thread of its own,
+// as it would on the chip, never in the caller.
+// ----------------------------------------------------------------
+
+typedef void (*tcpip_callback_fn)(void *ctx);
+
+err_t tcpip_callback(tcpip_callback_fn function, void *ctx);
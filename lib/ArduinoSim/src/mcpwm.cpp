@@ -0,0 +1,80 @@
+#include "driver/mcpwm.h"
+#include "simFan.h"
+
+#define CAPTURE_TICKS_PER_MICRO 80
+
+namespace
+{
+    struct CaptureChannel
+    {
+        bool enabled = false;
+        mcpwm_capture_config_t config;
+        uint32_t edges = 0;
+    };
+
+    CaptureChannel channels[MCPWM_UNIT_MAX][MCPWM_CAP_MAX];
+    bool listening = false;
+
+    // an edge is the falling edge of a tacho pulse, channels capturing
+    // rising edges only see nothing
+    void onFanEdge(uint64_t micros)
+    {
+        for (int unit = 0; unit < MCPWM_UNIT_MAX; unit++)
+        {
+            for (int id = 0; id < MCPWM_CAP_MAX; id++)
+            {
+                CaptureChannel &channel = channels[unit][id];
+                if (!channel.enabled || !(channel.config.cap_edge & MCPWM_NEG_EDGE))
+                {
+                    continue;
+                }
+
+                uint32_t prescale = channel.config.cap_prescale > 0 ? channel.config.cap_prescale : 1;
+                if (++channel.edges % prescale != 0 || channel.config.capture_cb == nullptr)
+                {
+                    continue;
+                }
+
+                cap_event_data_t event = {MCPWM_NEG_EDGE, (uint32_t)(micros * CAPTURE_TICKS_PER_MICRO)};
+                channel.config.capture_cb((mcpwm_unit_t)unit, (mcpwm_capture_channel_id_t)id, &event,
+                                          channel.config.user_data);
+            }
+        }
+    }
+}
+
+esp_err_t mcpwm_gpio_init(mcpwm_unit_t mcpwm_num, mcpwm_io_signals_t, int gpio_num)
+{
+    return mcpwm_num < MCPWM_UNIT_MAX && gpio_num >= 0 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t mcpwm_capture_enable_channel(mcpwm_unit_t mcpwm_num, mcpwm_capture_channel_id_t cap_channel,
+                                       const mcpwm_capture_config_t *cap_conf)
+{
+    if (mcpwm_num >= MCPWM_UNIT_MAX || cap_channel >= MCPWM_CAP_MAX || cap_conf == nullptr)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (!listening)
+    {
+        sim::Fan::addEdgeListener(onFanEdge);
+        listening = true;
+    }
+
+    CaptureChannel &channel = channels[mcpwm_num][cap_channel];
+    channel.config = *cap_conf;
+    channel.edges = 0;
+    channel.enabled = true;
+    return ESP_OK;
+}
+
+esp_err_t mcpwm_capture_disable_channel(mcpwm_unit_t mcpwm_num, mcpwm_capture_channel_id_t cap_channel)
+{
+    if (mcpwm_num >= MCPWM_UNIT_MAX || cap_channel >= MCPWM_CAP_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    channels[mcpwm_num][cap_channel].enabled = false;
+    return ESP_OK;
+}
@@ -0,0 +1,198 @@
+#include "nvs.h"
+#include "simConfig.h"
+#include "esp_system.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // "namespace/key" -> value
+    std::map<std::string, std::vector<uint8_t>> store;
+    std::vector<std::string> namespaces;     // handle - 1 is the index
+    bool loaded = false;
+    uint32_t writes = 0;
+    uint32_t commits = 0;
+
+    void load()
+    {
+        loaded = true;
+        FILE *file = fopen(sim::config().nvsPath, "rb");
+        if (!file)
+        {
+            return;
+        }
+
+        // records of: uint16 name length, name, uint32 value length, value
+        uint16_t nameLength;
+        while (fread(&nameLength, sizeof(nameLength), 1, file) == 1)
+        {
+            std::string name(nameLength, '\0');
+            uint32_t valueLength;
+            if (fread(&name[0], 1, nameLength, file) != nameLength ||
+                fread(&valueLength, sizeof(valueLength), 1, file) != 1)
+            {
+                break;
+            }
+            std::vector<uint8_t> value(valueLength);
+            if (fread(value.data(), 1, valueLength, file) != valueLength)
+            {
+                break;
+            }
+            store[name] = std::move(value);
+        }
+        fclose(file);
+    }
+
+    void save()
+    {
+        FILE *file = fopen(sim::config().nvsPath, "wb");
+        if (!file)
+        {
+            return;
+        }
+        for (const auto &entry : store)
+        {
+            uint16_t nameLength = entry.first.size();
+            uint32_t valueLength = entry.second.size();
+            fwrite(&nameLength, sizeof(nameLength), 1, file);
+            fwrite(entry.first.data(), 1, nameLength, file);
+            fwrite(&valueLength, sizeof(valueLength), 1, file);
+            fwrite(entry.second.data(), 1, valueLength, file);
+        }
+        fclose(file);
+    }
+
+    bool entryName(nvs_handle_t handle, const char *key, std::string &name)
+    {
+        if (handle == 0 || handle > namespaces.size())
+        {
+            return false;
+        }
+        name = namespaces[handle - 1] + "/" + key;
+        return true;
+    }
+}
+
+esp_err_t nvs_open(const char *namespaceName, nvs_open_mode_t, nvs_handle_t *outHandle)
+{
+    if (!loaded)
+    {
+        load();
+    }
+    if (strlen(namespaceName) >= NVS_KEY_NAME_MAX_SIZE)
+    {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+    namespaces.push_back(namespaceName);
+    *outHandle = namespaces.size();
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t)
+{
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    std::string name;
+    if (!entryName(handle, key, name))
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE)
+    {
+        return ESP_ERR_NVS_KEY_TOO_LONG;
+    }
+
+    const uint8_t *bytes = static_cast<const uint8_t *>(value);
+    if (++writes == sim::config().nvsTearWrite)
+    {
+        // a torn write, then the restart, which must not tear again
+        store[name].assign(bytes, bytes + length / 2);
+        save();
+        printf("Simulation: power lost writing %s, %zu of %zu bytes stored\n", key, length / 2, length);
+        unsetenv("FAN_SIM_NVS_TEAR_WRITE");
+        esp_restart();
+    }
+    store[name].assign(bytes, bytes + length);
+    save();
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *outValue, size_t *length)
+{
+    std::string name;
+    if (!entryName(handle, key, name))
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+
+    auto it = store.find(name);
+    if (it == store.end())
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (outValue == nullptr)
+    {
+        *length = it->second.size();
+        return ESP_OK;
+    }
+    if (*length < it->second.size())
+    {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+
+    memcpy(outValue, it->second.data(), it->second.size());
+    *length = it->second.size();
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    std::string name;
+    if (!entryName(handle, key, name))
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (store.erase(name) == 0)
+    {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    save();
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t handle)
+{
+    if (handle == 0 || handle > namespaces.size())
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+
+    std::string prefix = namespaces[handle - 1] + "/";
+    for (auto it = store.begin(); it != store.end();)
+    {
+        it = it->first.compare(0, prefix.size(), prefix) == 0 ? store.erase(it) : std::next(it);
+    }
+    save();
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    if (handle == 0 || handle > namespaces.size())
+    {
+        return ESP_ERR_NVS_INVALID_HANDLE;
+    }
+    if (++commits <= sim::config().nvsFailCommits)
+    {
+        printf("Simulation: NVS commit %u failed\n", commits);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
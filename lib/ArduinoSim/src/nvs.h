@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "esp_err.h"
+
+// ----------------------------------------------------------------
+// NVS key/value storage for the native build
+//
+// Blobs only (all the firmware uses), kept in memory and written to a
+// file (sim_nvs.bin by default, see FAN_SIM_NVS) on every change so
+// they survive a simulated restart. As on the device, a set is stored
+// straight away and nvs_commit() has nothing left to do.
+//
+// FAN_SIM_NVS_TEAR_WRITE cuts the power during a write: only the first
+// half of the blob is stored and the simulator restarts.
+// ----------------------------------------------------------------
+
+#define ESP_ERR_NVS_BASE 0x1100
+#define ESP_ERR_NVS_NOT_FOUND (ESP_ERR_NVS_BASE + 0x02)
+#define ESP_ERR_NVS_INVALID_HANDLE (ESP_ERR_NVS_BASE + 0x07)
+#define ESP_ERR_NVS_KEY_TOO_LONG (ESP_ERR_NVS_BASE + 0x0c)
+#define ESP_ERR_NVS_INVALID_LENGTH (ESP_ERR_NVS_BASE + 0x0e)
+
+#define NVS_KEY_NAME_MAX_SIZE 16 // includes the terminator
+
+typedef uint32_t nvs_handle_t;
+
+typedef enum
+{
+    NVS_READONLY,
+    NVS_READWRITE
+} nvs_open_mode_t;
+
+esp_err_t nvs_open(const char *namespaceName, nvs_open_mode_t openMode, nvs_handle_t *outHandle);
+void nvs_close(nvs_handle_t handle);
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length);
+
+// with outValue nullptr, only sets *length to the stored size
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *outValue, size_t *length);
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key);
+esp_err_t nvs_erase_all(nvs_handle_t handle);
+esp_err_t nvs_commit(nvs_handle_t handle);
@@ -0,0 +1,133 @@
+#include "driver/pcnt.h"
+#include "simFan.h"
+
+namespace
+{
+    struct Unit
+    {
+        bool configured = false;
+        int edgesPerPulse = 0;      // rising and/or falling edges counted
+        int16_t highLimit = 0;
+        bool paused = false;
+        uint64_t clearedPulses = 0; // fan pulses when the count was last 0
+        int64_t pausedCount = 0;
+        uint16_t filter = 0;
+        bool filterEnabled = false;
+    };
+
+    Unit units[PCNT_UNIT_MAX];
+
+    int64_t edgesSinceClear(const Unit &unit)
+    {
+        if (unit.paused)
+        {
+            return unit.pausedCount;
+        }
+        return (int64_t)(sim::Fan::tachoPulses() - unit.clearedPulses) * unit.edgesPerPulse;
+    }
+}
+
+esp_err_t pcnt_unit_config(const pcnt_config_t *config)
+{
+    if (config == nullptr || config->unit >= PCNT_UNIT_MAX || config->channel >= PCNT_CHANNEL_MAX ||
+        config->counter_h_lim < 0 || config->counter_l_lim > 0)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    Unit &unit = units[config->unit];
+    unit.configured = true;
+    unit.edgesPerPulse = (config->pos_mode == PCNT_COUNT_INC) + (config->neg_mode == PCNT_COUNT_INC);
+    unit.highLimit = config->counter_h_lim;
+    unit.paused = false;
+    unit.clearedPulses = sim::Fan::tachoPulses();
+    return ESP_OK;
+}
+
+esp_err_t pcnt_get_counter_value(pcnt_unit_t pcnt_unit, int16_t *count)
+{
+    if (pcnt_unit >= PCNT_UNIT_MAX || !units[pcnt_unit].configured || count == nullptr)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // the hardware goes back to 0 on reaching the high limit
+    const Unit &unit = units[pcnt_unit];
+    int64_t edges = edgesSinceClear(unit);
+    *count = unit.highLimit > 0 ? edges % unit.highLimit : (int16_t)edges;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_counter_pause(pcnt_unit_t pcnt_unit)
+{
+    if (pcnt_unit >= PCNT_UNIT_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    Unit &unit = units[pcnt_unit];
+    if (!unit.paused)
+    {
+        unit.pausedCount = edgesSinceClear(unit);
+        unit.paused = true;
+    }
+    return ESP_OK;
+}
+
+esp_err_t pcnt_counter_resume(pcnt_unit_t pcnt_unit)
+{
+    if (pcnt_unit >= PCNT_UNIT_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    Unit &unit = units[pcnt_unit];
+    if (unit.paused)
+    {
+        int edgesPerPulse = unit.edgesPerPulse > 0 ? unit.edgesPerPulse : 1;
+        unit.clearedPulses = sim::Fan::tachoPulses() - unit.pausedCount / edgesPerPulse;
+        unit.paused = false;
+    }
+    return ESP_OK;
+}
+
+esp_err_t pcnt_counter_clear(pcnt_unit_t pcnt_unit)
+{
+    if (pcnt_unit >= PCNT_UNIT_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    Unit &unit = units[pcnt_unit];
+    unit.pausedCount = 0;
+    unit.clearedPulses = sim::Fan::tachoPulses();
+    return ESP_OK;
+}
+
+// in APB clock cycles, pulses shorter than this are ignored
+esp_err_t pcnt_set_filter_value(pcnt_unit_t unit, uint16_t filter_val)
+{
+    if (unit >= PCNT_UNIT_MAX || filter_val > 1023)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    units[unit].filter = filter_val;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_filter_enable(pcnt_unit_t unit)
+{
+    if (unit >= PCNT_UNIT_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    units[unit].filterEnabled = true;
+    return ESP_OK;
+}
+
+esp_err_t pcnt_filter_disable(pcnt_unit_t unit)
+{
+    if (unit >= PCNT_UNIT_MAX)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    units[unit].filterEnabled = false;
+    return ESP_OK;
+}
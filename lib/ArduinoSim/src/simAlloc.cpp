@@ -0,0 +1,133 @@
+#include "simAlloc.h"
+
+#include <atomic>
+#include <cerrno>
+#include <malloc.h>
+
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *ptr, size_t size);
+    void *__libc_memalign(size_t alignment, size_t size);
+    void __libc_free(void *ptr);
+}
+
+namespace
+{
+    // constant initialised, so usable by allocations made before main()
+    std::atomic<uint64_t> allocations{0};
+    std::atomic<int64_t> liveBytes{0};
+    std::atomic<int64_t> peakBytes{0};
+
+    void added(void *ptr, size_t previousSize = 0)
+    {
+        if (ptr == nullptr)
+        {
+            return;
+        }
+
+        allocations++;
+        int64_t live = liveBytes += static_cast<int64_t>(malloc_usable_size(ptr)) - static_cast<int64_t>(previousSize);
+
+        int64_t peak = peakBytes.load();
+        while (live > peak && !peakBytes.compare_exchange_weak(peak, live))
+        {
+        }
+    }
+
+    void removed(void *ptr)
+    {
+        if (ptr != nullptr)
+        {
+            liveBytes -= malloc_usable_size(ptr);
+        }
+    }
+}
+
+extern "C"
+{
+    void *malloc(size_t size)
+    {
+        void *ptr = __libc_malloc(size);
+        added(ptr);
+        return ptr;
+    }
+
+    void *calloc(size_t count, size_t size)
+    {
+        void *ptr = __libc_calloc(count, size);
+        added(ptr);
+        return ptr;
+    }
+
+    void *realloc(void *ptr, size_t size)
+    {
+        size_t previousSize = ptr ? malloc_usable_size(ptr) : 0;
+        void *result = __libc_realloc(ptr, size);
+        if (result != nullptr)
+        {
+            added(result, previousSize);
+        }
+        else if (size == 0)
+        {
+            // realloc(ptr, 0) frees
+            liveBytes -= previousSize;
+        }
+        return result;
+    }
+
+    void *memalign(size_t alignment, size_t size)
+    {
+        void *ptr = __libc_memalign(alignment, size);
+        added(ptr);
+        return ptr;
+    }
+
+    void *aligned_alloc(size_t alignment, size_t size)
+    {
+        return memalign(alignment, size);
+    }
+
+    int posix_memalign(void **result, size_t alignment, size_t size)
+    {
+        void *ptr = memalign(alignment, size);
+        if (ptr == nullptr)
+        {
+            return ENOMEM;
+        }
+        *result = ptr;
+        return 0;
+    }
+
+    void free(void *ptr)
+    {
+        removed(ptr);
+        __libc_free(ptr);
+    }
+}
+
+namespace sim
+{
+    uint64_t allocationCount()
+    {
+        return allocations.load();
+    }
+
+    size_t heapInUse()
+    {
+        int64_t live = liveBytes.load();
+        return live > 0 ? static_cast<size_t>(live) : 0;
+    }
+
+    size_t peakHeapInUse()
+    {
+        int64_t peak = peakBytes.load();
+        return peak > 0 ? static_cast<size_t>(peak) : 0;
+    }
+
+    void resetPeakHeap()
+    {
+        peakBytes = liveBytes.load();
+    }
+}
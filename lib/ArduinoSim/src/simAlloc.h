@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// ----------------------------------------------------------------
+// Heap accounting for the native build
+//
+// malloc/calloc/realloc/free are replaced for the whole process
+// (operator new ends up here too), so every heap allocation made by
+// the firmware, the libraries and the shim is counted. The device
+// has no equivalent, this is what the simulator is for.
+// ----------------------------------------------------------------
+
+namespace sim
+{
+    // number of successful allocations (realloc included) since start
+    uint64_t allocationCount();
+
+    // bytes currently allocated and the most allocated at once since
+    // the last resetPeakHeap()
+    size_t heapInUse();
+    size_t peakHeapInUse();
+    void resetPeakHeap();
+}
@@ -0,0 +1,99 @@
+#include "simClock.h"
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sim
+{
+    namespace
+    {
+        typedef std::chrono::steady_clock RealClock;
+
+        // function local so the clock is usable from the constructors of
+        // other globals, whatever order they are initialised in
+        struct ClockState
+        {
+            std::mutex mutex;
+            RealClock::time_point realBase = RealClock::now();
+            uint64_t simBaseMicros = 0;
+            double speed = 1.0;
+        };
+
+        ClockState &state()
+        {
+            static ClockState instance;
+            return instance;
+        }
+
+        std::vector<PollHandler> &pollHandlers()
+        {
+            static std::vector<PollHandler> handlers;
+            return handlers;
+        }
+    }
+
+    extern uint64_t durationMicros;
+
+    uint64_t Clock::nowMicros()
+    {
+        ClockState &s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto realElapsed = std::chrono::duration_cast<std::chrono::microseconds>(RealClock::now() - s.realBase).count();
+        return s.simBaseMicros + static_cast<uint64_t>(realElapsed * s.speed);
+    }
+
+    void Clock::sleepMicros(uint64_t micros)
+    {
+        uint64_t until = nowMicros() + micros;
+        std::this_thread::sleep_for(std::chrono::microseconds(static_cast<uint64_t>(micros / getSpeed())));
+
+        // the scaled sleep can come back a little early through rounding
+        while (nowMicros() < until)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    void Clock::setSpeed(double multiplier)
+    {
+        if (multiplier <= 0)
+        {
+            return;
+        }
+
+        uint64_t now = nowMicros();
+
+        ClockState &s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        s.realBase = RealClock::now();
+        s.simBaseMicros = now;
+        s.speed = multiplier;
+    }
+
+    double Clock::getSpeed()
+    {
+        ClockState &s = state();
+        std::lock_guard<std::mutex> lock(s.mutex);
+        return s.speed;
+    }
+
+    void addPollHandler(PollHandler handler)
+    {
+        pollHandlers().push_back(handler);
+    }
+
+    void poll()
+    {
+        for (PollHandler handler : pollHandlers())
+        {
+            handler();
+        }
+    }
+
+    bool finished()
+    {
+        return durationMicros != 0 && Clock::nowMicros() >= durationMicros;
+    }
+}
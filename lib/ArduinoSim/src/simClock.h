@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+// ----------------------------------------------------------------
+// Simulated clock for the native build
+//
+// All of the Arduino time functions (millis, micros, delay) and
+// esp_timer_get_time() read this clock. It runs at a configurable
+// multiple of real time so a soak test of several days can be run
+// in minutes, e.g. a speed of 1000 runs one day in ~86 seconds.
+// ----------------------------------------------------------------
+
+namespace sim
+{
+    class Clock
+    {
+    public:
+        // simulated microseconds since "boot"
+        static uint64_t nowMicros();
+
+        // advance the simulation by at least the given number of simulated
+        // microseconds, sleeping for the equivalent (scaled) real time
+        static void sleepMicros(uint64_t micros);
+
+        static void setSpeed(double multiplier);
+        static double getSpeed();
+    };
+
+    // Called from yield(), delay() and between passes of loop() to deliver
+    // any simulated events (WiFi events etc.) that have become due.
+    void poll();
+
+    // Register a function that poll() should call. Used by the simulated
+    // peripherals to deliver their events on the main thread.
+    typedef void (*PollHandler)();
+    void addPollHandler(PollHandler handler);
+
+    // true once the requested simulation duration (--duration) has passed
+    bool finished();
+}
@@ -0,0 +1,58 @@
+#include "simConfig.h"
+#include "simClock.h"
+
+#include <cstdlib>
+
+namespace sim
+{
+    uint64_t durationMicros = 0;
+
+    namespace
+    {
+        Config load()
+        {
+            Config c;
+
+            if (const char *v = getenv("FAN_SIM_SPEED"))
+                c.speed = atof(v);
+            if (const char *v = getenv("FAN_SIM_DURATION"))
+                c.durationSecs = strtoull(v, nullptr, 10);
+            if (const char *v = getenv("FAN_SIM_EEPROM"))
+                c.eepromPath = v;
+            if (const char *v = getenv("FAN_SIM_NVS"))
+                c.nvsPath = v;
+            if (const char *v = getenv("FAN_SIM_NVS_TEAR_WRITE"))
+                c.nvsTearWrite = strtoul(v, nullptr, 10);
+            if (const char *v = getenv("FAN_SIM_NVS_FAIL_COMMITS"))
+                c.nvsFailCommits = strtoul(v, nullptr, 10);
+            if (const char *v = getenv("FAN_SIM_WIFI_CONNECT_MS"))
+                c.wifiConnectMillis = strtoul(v, nullptr, 10);
+            if (const char *v = getenv("FAN_SIM_WIFI_DROP_EVERY"))
+                c.wifiDropEverySecs = strtoul(v, nullptr, 10);
+            if (const char *v = getenv("FAN_SIM_WIFI_DHCP_FAILS"))
+                c.wifiDhcpFails = strtoul(v, nullptr, 10);
+            if (const char *v = getenv("FAN_SIM_WIFI_OUTAGE"))
+                c.wifiOutageSecs = strtoul(v, nullptr, 10);
+            if (const char *v = getenv("FAN_SIM_FAN_PWM_PIN"))
+                c.fanPwmPin = atoi(v);
+            if (const char *v = getenv("FAN_SIM_FAN_RELAY_PIN"))
+                c.fanRelayPin = atoi(v);
+            if (const char *v = getenv("FAN_SIM_FAN_MAX_RPM"))
+                c.fanMaxRpm = atof(v);
+            if (const char *v = getenv("FAN_SIM_FAN_PULSES"))
+                c.fanPulsesPerRev = strtoul(v, nullptr, 10);
+            if (const char *v = getenv("FAN_SIM_FAN_JITTER"))
+                c.fanJitterPercent = atof(v);
+
+            Clock::setSpeed(c.speed);
+            durationMicros = c.durationSecs * 1000000ULL;
+            return c;
+        }
+    }
+
+    const Config &config()
+    {
+        static Config instance = load();
+        return instance;
+    }
+}
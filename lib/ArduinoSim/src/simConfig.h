@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+// ----------------------------------------------------------------
+// Simulator configuration
+//
+// Read from environment variables on first use, so it is available
+// to the constructors of the firmware's globals (which run before
+// main()):
+//
+//   FAN_SIM_SPEED           clock multiplier, e.g. 1000 (default 1)
+//   FAN_SIM_DURATION        stop after this many simulated seconds (default 0 = run forever)
+//   FAN_SIM_EEPROM          file backing the EEPROM emulation (default sim_eeprom.bin)
+//   FAN_SIM_NVS             file backing NVS (default sim_nvs.bin)
+//   FAN_SIM_NVS_TEAR_WRITE  lose power part way through the Nth NVS write (default 0 = never)
+//   FAN_SIM_NVS_FAIL_COMMITS fail the first N NVS commits (default 0)
+//   FAN_SIM_WIFI_CONNECT_MS simulated association time (default 1500)
+//   FAN_SIM_WIFI_DROP_EVERY drop the WiFi link every N simulated seconds (default 0 = never)
+//   FAN_SIM_WIFI_OUTAGE     length of each simulated outage in seconds (default 30)
+//   FAN_SIM_WIFI_DHCP_FAILS the first N associations never get an address (default 0)
+//   FAN_SIM_FAN_PWM_PIN     pin the simulated fan's PWM input is on (default 32)
+//   FAN_SIM_FAN_RELAY_PIN   pin switching the fan's power, -1 = always on (default 25)
+//   FAN_SIM_FAN_MAX_RPM     the fan's speed at 100% duty (default 3000)
+//   FAN_SIM_FAN_PULSES      tacho pulses per revolution (default 2)
+//   FAN_SIM_FAN_JITTER      random jitter of each tacho edge, percent of a pulse period (default 2)
+// ----------------------------------------------------------------
+
+namespace sim
+{
+    struct Config
+    {
+        double speed = 1.0;
+        uint64_t durationSecs = 0;
+        const char *eepromPath = "sim_eeprom.bin";
+        const char *nvsPath = "sim_nvs.bin";
+        uint32_t nvsTearWrite = 0;
+        uint32_t nvsFailCommits = 0;
+        uint32_t wifiConnectMillis = 1500;
+        uint32_t wifiDropEverySecs = 0;
+        uint32_t wifiOutageSecs = 30;
+        uint32_t wifiDhcpFails = 0;
+        int fanPwmPin = 32;
+        int fanRelayPin = 25;
+        double fanMaxRpm = 3000;
+        uint32_t fanPulsesPerRev = 2;
+        double fanJitterPercent = 2;
+    };
+
+    const Config &config();
+}
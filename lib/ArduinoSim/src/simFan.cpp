@@ -0,0 +1,130 @@
+#include "simFan.h"
+#include "simClock.h"
+#include "simConfig.h"
+#include "Arduino.h"
+#include "esp32-hal-ledc.h"
+
+#include <cmath>
+#include <mutex>
+#include <random>
+#include <vector>
+
+namespace
+{
+    const double STALL_DUTY = 0.08;         // below this the fan stops
+    const double START_DUTY = 0.14;         // and it needs this much to start again
+    const double STOP_RPM = 30;             // coasting slower than this, friction stops it
+    const double MIN_SPEED = 0.2;           // of the maximum, at the stall duty
+    const double CURVE = 0.6;               // exponent, the fan speeds up fastest at low duties
+    const double TIME_CONSTANT_US = 1.5e6;  // to get 63% of the way to a new speed
+    const double POLE_ASYMMETRY = 0.03;     // of a period, every other edge is this late
+    const uint64_t STEP_US = 1000;
+
+    std::mutex lock;
+    uint64_t modelMicros = 0;
+    double speed = 0;                       // rpm
+    double pulses = 0;
+    std::vector<sim::Fan::EdgeListener> listeners;
+    std::mt19937 jitterEngine{12345};
+
+    double targetSpeed()
+    {
+        const sim::Config &config = sim::config();
+        if (config.fanRelayPin >= 0 && digitalRead(config.fanRelayPin) != HIGH)
+        {
+            return 0;
+        }
+
+        double duty = sim::ledcDutyOnPin(config.fanPwmPin);
+        if (duty < STALL_DUTY || (speed == 0 && duty < START_DUTY))
+        {
+            return 0;
+        }
+        double fraction = (duty - STALL_DUTY) / (1 - STALL_DUTY);
+        return config.fanMaxRpm * (MIN_SPEED + (1 - MIN_SPEED) * pow(fraction, CURVE));
+    }
+
+    // tells the listeners about the edges from previous pulses to now,
+    // which the model got to over step microseconds
+    void edgesBetween(double previous, uint64_t step)
+    {
+        // the offsets are capped, so edges stay in order as the fan stops
+        double periodMicros = std::min(60e6 / (speed * sim::config().fanPulsesPerRev), 100e3);
+        std::uniform_real_distribution<double> jitter(-1, 1);
+
+        for (uint64_t edge = (uint64_t)previous + 1; edge <= (uint64_t)pulses; edge++)
+        {
+            double micros = modelMicros + step * (edge - previous) / (pulses - previous);
+            micros += (edge % 2) * POLE_ASYMMETRY * periodMicros;
+            micros += jitter(jitterEngine) * sim::config().fanJitterPercent / 100 * periodMicros;
+            for (sim::Fan::EdgeListener listener : listeners)
+            {
+                listener((uint64_t)micros);
+            }
+        }
+    }
+
+    // moves the model on to now, in steps short enough for the speed
+    // to be smooth. The duty is taken to have been constant since the
+    // last call, it is only read when something looks at the fan.
+    void advance()
+    {
+        uint64_t now = sim::Clock::nowMicros();
+        double target = targetSpeed();
+        double pulsesPerRev = sim::config().fanPulsesPerRev;
+
+        while (modelMicros < now)
+        {
+            uint64_t step = std::min(STEP_US, now - modelMicros);
+
+            // settled, do the rest in one go
+            if (fabs(target - speed) < 0.01 || (target == 0 && speed < STOP_RPM))
+            {
+                step = now - modelMicros;
+                speed = target;
+            }
+            else
+            {
+                speed += (target - speed) * (1 - exp(-(double)step / TIME_CONSTANT_US));
+            }
+
+            double previous = pulses;
+            pulses += speed / 60 * pulsesPerRev * step / 1e6;
+            if (!listeners.empty())
+            {
+                edgesBetween(previous, step);
+            }
+            modelMicros += step;
+        }
+    }
+
+    void pollFan()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        advance();
+    }
+}
+
+uint64_t sim::Fan::tachoPulses()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    advance();
+    return (uint64_t)pulses;
+}
+
+double sim::Fan::rpm()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    advance();
+    return speed;
+}
+
+void sim::Fan::addEdgeListener(EdgeListener listener)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (listeners.empty())
+    {
+        addPollHandler(pollFan);
+    }
+    listeners.push_back(listener);
+}
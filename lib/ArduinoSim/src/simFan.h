@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+
+// ----------------------------------------------------------------
+// Simulated fan
+//
+// A 4-wire PC fan on the pins in the sim configuration: powered while
+// its relay pin is HIGH, with a speed set by the duty of the LEDC
+// channel on its PWM pin. The speed follows the duty along a curve
+// that is not a straight line, below the stall duty it stops, from
+// standstill it needs a higher duty to start, and it takes a couple of
+// seconds to spin up or down. Its tacho gives
+// FAN_SIM_FAN_PULSES pulses per revolution, which the simulated
+// counters read. Like a real fan's, the pulses aren't evenly spaced:
+// the magnet's poles are a little unequal, so every other period is
+// longer, and each edge has a random jitter of FAN_SIM_FAN_JITTER.
+// ----------------------------------------------------------------
+
+namespace sim
+{
+    class Fan
+    {
+    public:
+        // tacho pulses since boot
+        static uint64_t tachoPulses();
+
+        static double rpm();
+
+        // called with the time of each tacho edge, in simulated
+        // microseconds, from sim::poll()
+        typedef void (*EdgeListener)(uint64_t micros);
+        static void addEdgeListener(EdgeListener listener);
+    };
+}
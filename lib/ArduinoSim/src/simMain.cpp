@@ -0,0 +1,24 @@
+#include "Arduino.h"
+#include "simClock.h"
+#include "simConfig.h"
+
+// The arduino-esp32 core runs setup() once and then loop() forever from
+// its loop task. The simulator does the same on the main thread, stopping
+// once FAN_SIM_DURATION simulated seconds have passed.
+int main()
+{
+    const sim::Config &config = sim::config();
+    printf("Simulation: speed x%.1f, duration %llus\n",
+           config.speed, static_cast<unsigned long long>(config.durationSecs));
+
+    setup();
+
+    while (!sim::finished())
+    {
+        loop();
+        sim::poll();
+    }
+
+    Serial.flush();
+    return 0;
+}
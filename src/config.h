@@ -31,7 +31,7 @@
 #endif
 
 #ifndef DEFAULT_MAX_RPM
-  #define DEFAULT_MAX_RPM 4500 // only used for showing at how many percent fan is running
+  #define DEFAULT_MAX_RPM 4500 // highest speed setRPM asks for, and the feed-forward's full scale
 #endif
 
 #ifndef DEFAULT_MIN_PERCENT
@@ -54,6 +54,62 @@
   #define PWM_RESOLUTION 8
 #endif
 
+// fan state reporting over MQTT: one retained "state" document sent when
+// a value changes (the current speed only once it has moved by the
+// deadband), and at least every heartbeat. The old per-field topics
+// (currentSpeed, targetSpeed, isRunning every 5 seconds) can be kept
+// for existing subscribers.
+#ifndef DEFAULT_FAN_STATE_MESSAGE
+  #define DEFAULT_FAN_STATE_MESSAGE true
+#endif
+
+#ifndef DEFAULT_FAN_LEGACY_TOPICS
+  #define DEFAULT_FAN_LEGACY_TOPICS true
+#endif
+
+#ifndef DEFAULT_FAN_STATE_DEADBAND
+  #define DEFAULT_FAN_STATE_DEADBAND 5 // percent
+#endif
+
+#ifndef DEFAULT_FAN_STATE_HEARTBEAT_SECS
+  #define DEFAULT_FAN_STATE_HEARTBEAT_SECS 60 // 0 = only on change
+#endif
+
+// speed changes are ramped by the LEDC's fade hardware, in segments of
+// at most FAN_FADE_SEGMENT_MILLIS. A fade can't be cut short, so a new
+// speed takes effect at the end of the segment under way.
+#ifndef DEFAULT_FAN_RAMP_RATE
+  #define DEFAULT_FAN_RAMP_RATE 5 // percent of duty per second, 0 = straight to the new speed
+#endif
+
+#ifndef DEFAULT_FAN_RPM_RAMP_RATE
+  #define DEFAULT_FAN_RPM_RAMP_RATE 0 // rpm per second for setRPM's target, 0 = a step
+#endif
+
+#define FAN_FADE_SEGMENT_MILLIS 1000
+
+// closed-loop speed control (fan/setRPM), gains in millionths of a percent of duty
+#ifndef DEFAULT_FAN_RPM_KP
+  #define DEFAULT_FAN_RPM_KP 60000 // per rpm of error
+#endif
+
+#ifndef DEFAULT_FAN_RPM_KI
+  #define DEFAULT_FAN_RPM_KI 5000 // per rpm of error, added each control period
+#endif
+
+#define FAN_RPM_CONTROL_PERIOD_MILLIS 100   // the controller runs on this fixed period
+#define FAN_RPM_SETTLED_PERCENT 2           // within this much of the target is settled,
+#define FAN_RPM_SETTLED_MIN_RPM 30          // but never closer than this
+#define FAN_RPM_SETTLED_PERIODS 3           // for this many periods in a row
+
+// calibration sweep (fan/calibrate)
+#define FAN_CALIBRATION_SAMPLE_MILLIS 500       // between tacho readings
+#define FAN_CALIBRATION_STABLE_READINGS 4       // readings in a row within
+#define FAN_CALIBRATION_STABLE_PERCENT 2        // this much of each other is settled,
+#define FAN_CALIBRATION_STABLE_RPM 15           // or this many rpm for a slow fan
+#define FAN_CALIBRATION_STEP_TIMEOUT_MILLIS 15000   // a step that never settles takes the last reading
+#define FAN_CALIBRATION_MARGIN_PERCENT 2        // added to the measured stall and start duties
+
 
 // Relay / Mosfet
 #ifndef DEFAULT_RELAY_PIN
@@ -71,6 +127,27 @@
 #define TACHO_UPDATE_CYCLE 1000       // how often tacho speed shall be determined, in milliseconds
 #define NUMB_INTERRUPS_PER_ROTATION 2 // Number of interrupts ESP32 sees on tacho signal on a single fan rotation. All the fans I've seen trigger two interrups.
 
+#ifndef TACHO_PCNT_UNIT
+  #define TACHO_PCNT_UNIT PCNT_UNIT_0 // pulse counter unit counting the tacho pulses
+#endif
+
+#ifndef TACHO_FILTER_APB_CYCLES
+  #define TACHO_FILTER_APB_CYCLES 1023 // pulses shorter than this many 80 MHz cycles (12.8 us) are glitches, at most 1023
+#endif
+
+#ifndef DEFAULT_TACHO_PERIOD_MODE
+  #define DEFAULT_TACHO_PERIOD_MODE true // time each pulse for an update every revolution, rather than only counting them
+#endif
+
+#ifndef TACHO_MCPWM_UNIT
+  #define TACHO_MCPWM_UNIT MCPWM_UNIT_0 // capture unit timing the tacho pulses
+#endif
+
+#define TACHO_PERIOD_SAMPLES 8          // pulse periods the moving median is taken over
+#define TACHO_PERIOD_CHECK_MILLIS 10    // how often to look for a new revolution
+#define TACHO_PERIOD_MAX_PULSE_HZ 500   // faster than this, count the pulses rather than timing each one
+#define TACHO_STOPPED_MILLIS 1000       // no pulse for this long and the fan has stopped
+
 
 
 
@@ -129,7 +206,11 @@
 #endif
 
 #ifndef WIFI_TIMEOUT
-#define WIFI_TIMEOUT 10 // seconds
+#define WIFI_TIMEOUT 10 // seconds, per connection attempt
+#endif
+
+#ifndef WIFI_AP_RETRY_SECS
+#define WIFI_AP_RETRY_SECS 60 // while the fallback AP is up, retry the station this often
 #endif
 
 
@@ -185,14 +266,46 @@
     #define MQTT_TOPIC "airflow"
   #endif
 
-#ifndef MQTT_CONNECTION_TIMEOUT_SECS
-#define MQTT_CONNECTION_TIMEOUT_SECS 10 // seconds
+#ifndef MQTT_CONNECT_TIMEOUT_MILLIS
+#define MQTT_CONNECT_TIMEOUT_MILLIS 2000 // longest the TCP connect may take, it is polled and never blocks
+#endif
+
+// PubSubClient waits for CONNACK in whole seconds, this is the longest
+// a single loop() pass can block while connecting
+#ifndef MQTT_HANDSHAKE_TIMEOUT_SECS
+#define MQTT_HANDSHAKE_TIMEOUT_SECS 1
+#endif
+
+// retries back off exponentially from MIN to MAX, each wait is a random
+// time between half and all of the backoff so a fleet spreads out
+#ifndef MQTT_BACKOFF_MIN_MILLIS
+#define MQTT_BACKOFF_MIN_MILLIS 1000
+#endif
+
+#ifndef MQTT_BACKOFF_MAX_MILLIS
+#define MQTT_BACKOFF_MAX_MILLIS 120000 // 2 minutes
 #endif
 
 #ifndef MQTT_BUFFER_SIZE
 #define MQTT_BUFFER_SIZE 1280
 #endif
 
+#ifndef MQTT_JSON_CHUNK_BYTES
+#define MQTT_JSON_CHUNK_BYTES 128 // JSON is written to the socket this many bytes at a time
+#endif
+
+#ifndef MQTT_MAX_TOPIC_LENGTH
+#define MQTT_MAX_TOPIC_LENGTH 128 // full topic, prefix included
+#endif
+
+#ifndef MQTT_QUEUE_BYTES
+#define MQTT_QUEUE_BYTES 4096 // messages held while the broker is unreachable
+#endif
+
+#ifndef MQTT_QUEUE_DRAIN_PER_PASS
+#define MQTT_QUEUE_DRAIN_PER_PASS 4 // queued messages sent per loop() after a reconnect
+#endif
+
 #ifndef MQTT_KEEP_ALIVE
 #define MQTT_KEEP_ALIVE 60
 #endif
@@ -235,6 +348,60 @@
 #define WATCHDOG_MAX_LOOP_MILLIS 5
 #endif
 
+// ----------------------------------------------------------------
+// Scheduler
+// ----------------------------------------------------------------
+#ifndef SCHEDULER_MAX_JOBS
+#define SCHEDULER_MAX_JOBS 16
+#endif
+
+// Longest the main loop sleeps between passes, bounds how long a
+// polled module (e.g. the MQTT socket) can go without being serviced
+#ifndef SCHEDULER_MAX_IDLE_MILLIS
+#define SCHEDULER_MAX_IDLE_MILLIS 20 // milliseconds
+#endif
+
+// ----------------------------------------------------------------
+// Settings and their persistence
+// ----------------------------------------------------------------
+#ifndef SETTINGS_MAX_CATEGORIES
+#define SETTINGS_MAX_CATEGORIES 8
+#endif
+
+// Static block every Setting object is constructed in, see
+// settingsArena.h. The settings log shows how much is used.
+#ifndef SETTINGS_ARENA_BYTES
+#define SETTINGS_ARENA_BYTES 2560
+#endif
+
+// Changed settings are written to flash once there has been no further
+// change for the debounce time, but no later than the max delay
+#ifndef SETTINGS_SAVE_DEBOUNCE_MILLIS
+#define SETTINGS_SAVE_DEBOUNCE_MILLIS 2000 // milliseconds
+#endif
+
+#ifndef SETTINGS_SAVE_MAX_DELAY_MILLIS
+#define SETTINGS_SAVE_MAX_DELAY_MILLIS 10000 // milliseconds
+#endif
+
+// a write or commit that failed is tried again after the retry time,
+// doubling each time it fails again up to the max
+#ifndef SETTINGS_RETRY_MIN_MILLIS
+#define SETTINGS_RETRY_MIN_MILLIS 1000 // milliseconds
+#endif
+
+#ifndef SETTINGS_RETRY_MAX_MILLIS
+#define SETTINGS_RETRY_MAX_MILLIS 60000 // milliseconds
+#endif
+
+#ifndef SETTINGS_TASK_STACK_SIZE
+#define SETTINGS_TASK_STACK_SIZE 4096
+#endif
+
+#ifndef SETTINGS_TASK_PRIORITY
+#define SETTINGS_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#endif
+
 // ----------------------------------------------------------------
 // Power management and sleep mode
 // This is currently experimental and shouldn't be used. 
@@ -10,37 +10,32 @@ CPUTemp::~CPUTemp() {
 
 };
 
-void CPUTemp::setup() {
-
+void CPUTemp::setup()
+{
+#if not defined(ESP8266) && not defined(CONFIG_IDF_TARGET_ESP32S2) // ESP32S2
+    // first reading straight away, then every INTERNAL_TEMPERATURE_INTERVAL_MS
+    scheduler.addPeriodic("cpuTemp.read", INTERNAL_TEMPERATURE_INTERVAL_MS, 100,
+                          std::bind(&CPUTemp::readTemperature, this));
+#endif
 };
 
 void CPUTemp::loop()
 {
-#if not defined(ESP8266) && not defined(CONFIG_IDF_TARGET_ESP32S2) // ESP32S2
-
-    // set a default that means we will read the temperature on the first loop
-    static unsigned long lastCheck = 0 - INTERNAL_TEMPERATURE_INTERVAL_MS;
-
-    if (millis() - lastCheck < INTERNAL_TEMPERATURE_INTERVAL_MS)
-        return;
-    lastCheck = millis();
+    // nothing to poll, the reading is a scheduled job
+}
 
+void CPUTemp::readTemperature()
+{
     // temperature, rounded to 2 decimal places
     temperature = roundf(temperatureRead() * 100) / 100;
 
 #ifdef ENABLE_MQTT
-    MQTT.publish("cpuTemp", String(temperature));
+    MQTT.publishFloat("cpuTemp", temperature, 2);
 #endif
 
     Log.printfln("CPU Temperature: %.2f", temperature);
-
-#endif
 }
 
-
-
-
-
 void CPUTemp::getInfoForLog(Logger &log) const
 {
     ModuleBase::getInfoForLog(log);
@@ -57,7 +52,7 @@ void CPUTemp::getInfoForLog(Logger &log) const
 
 
 
-String CPUTemp::getInfoForJson() const
+JsonDocument CPUTemp::getInfoForJson() const
 {
     JsonDocument doc = startJsonDoc();
 #if defined(ESP8266) || defined(CONFIG_IDF_TARGET_ESP32S2) // ESP32S2
@@ -67,8 +62,6 @@ String CPUTemp::getInfoForJson() const
     doc["temperature"] = temperature;
 #endif
     
-    String jsonString;
-    serializeJson(doc, jsonString);
-    return jsonString;
+    return doc;
 }
 
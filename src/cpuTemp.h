@@ -23,7 +23,10 @@ class CPUTemp : public ModuleBase
         void loop() override;
 
         void getInfoForLog(Logger &log) const override;
-        String getInfoForJson() const override;
+        JsonDocument getInfoForJson() const override;
+
+    private:
+        void readTemperature();
 
 };  // class CPUTemp
 
@@ -3,7 +3,7 @@
 #define FANCONTROLLER_H
 
 
-#include <wstring.h>
+#include <WString.h>
 #include <vector>
 #include <Arduino.h>
 
@@ -19,6 +19,7 @@
 #endif
 
 #include "fanPWM.h"
+#include "fanTacho.h"
 
 #ifdef USE_INTERNAL_TEMPERATURE_SENSOR
     #include "cpuTemp.h"
@@ -60,11 +61,13 @@ GLOBAL char versionString[] _INIT(TOSTRING(VERSION));
 
 GLOBAL Logger Log _INIT(Logger());
 GLOBAL SettingsManager settingsManager _INIT(SettingsManager());
+GLOBAL Scheduler scheduler _INIT(Scheduler());
 
 
 // Modules
 GLOBAL NetworkController Network _INIT(NetworkController(settingsManager));
 GLOBAL FanPWM Fan _INIT(FanPWM(settingsManager));
+GLOBAL FanTacho Tacho _INIT(FanTacho(settingsManager));
 
 #ifdef ENABLE_MQTT
 GLOBAL MQTTController MQTT _INIT(MQTTController(settingsManager));
@@ -75,7 +78,7 @@ GLOBAL MQTTController MQTT _INIT(MQTTController(settingsManager));
     GLOBAL CPUTemp CpuTemp _INIT(CPUTemp(settingsManager));
 #endif
 
-GLOBAL std::vector<ModuleBase *> modules _INIT_N(({&Network, &MQTT, &Fan, &CpuTemp}));
+GLOBAL std::vector<ModuleBase *> modules _INIT_N(({&Network, &MQTT, &Fan, &Tacho, &CpuTemp}));
 
 GLOBAL bool restartRequested _INIT(false);
 GLOBAL bool factoryResetRequested _INIT(false);
@@ -0,0 +1,134 @@
+#include "fanCurve.h"
+#include <charconv>
+#include <cstring>
+
+bool FanCurve::parse(const char *text)
+{
+    valid = false;
+
+    // stall, start, then the speeds
+    int values[2 + FAN_CURVE_POINTS];
+    const char *position = text;
+    const char *end = text + strlen(text);
+    for (int i = 0; i < 2 + FAN_CURVE_POINTS; i++)
+    {
+        auto result = std::from_chars(position, end, values[i]);
+        if (result.ec != std::errc() || values[i] < 0 || values[i] > UINT16_MAX)
+        {
+            return false;
+        }
+        position = result.ptr;
+        if (i < 1 + FAN_CURVE_POINTS)
+        {
+            if (position == end || *position != ',')
+            {
+                return false;
+            }
+            position++;
+        }
+    }
+    if (position != end || values[0] > 100 || values[1] > 100)
+    {
+        return false;
+    }
+
+    uint16_t measured[FAN_CURVE_POINTS];
+    for (int i = 0; i < FAN_CURVE_POINTS; i++)
+    {
+        measured[i] = values[2 + i];
+    }
+    set(values[0], values[1], measured);
+    return valid;
+}
+
+size_t FanCurve::format(char *buffer, size_t size) const
+{
+    int length = snprintf(buffer, size, "%u,%u", stallPercent, startPercent);
+    for (int i = 0; i < FAN_CURVE_POINTS && length < (int)size; i++)
+    {
+        length += snprintf(buffer + length, size - length, ",%u", rpm[i]);
+    }
+    return length < (int)size ? length : 0;
+}
+
+void FanCurve::set(byte stall, byte start, const uint16_t *measured)
+{
+    stallPercent = stall;
+    startPercent = start;
+
+    // stopped below the stall duty, and never slower at a higher duty
+    uint16_t fastest = 0;
+    for (int i = 0; i < FAN_CURVE_POINTS; i++)
+    {
+        if (dutyOfPoint(i) < stall)
+        {
+            rpm[i] = 0;
+            continue;
+        }
+        fastest = max(fastest, measured[i]);
+        rpm[i] = fastest;
+    }
+
+    buildInverse();
+}
+
+void FanCurve::buildInverse()
+{
+    // the slowest measured running speed
+    lowestRPM = 0;
+    for (int i = 0; i < FAN_CURVE_POINTS && lowestRPM == 0; i++)
+    {
+        lowestRPM = rpm[i];
+    }
+    highestRPM = rpm[FAN_CURVE_POINTS - 1];
+    valid = highestRPM > lowestRPM;
+    if (!valid)
+    {
+        return;
+    }
+
+    // walks up the curve once, as the speeds only rise
+    int point = 0;
+    for (int i = 0; i < FAN_CURVE_INVERSE_POINTS; i++)
+    {
+        int speed = lowestRPM + (int32_t)(highestRPM - lowestRPM) * i / (FAN_CURVE_INVERSE_POINTS - 1);
+        while (point < FAN_CURVE_POINTS - 2 && rpm[point + 1] < speed)
+        {
+            point++;
+        }
+
+        int32_t low = rpm[point];
+        int32_t high = rpm[point + 1];
+        int32_t dutyLow = (int32_t)dutyOfPoint(point) << 16;
+        int32_t dutyHigh = (int32_t)dutyOfPoint(point + 1) << 16;
+        int32_t duty = high > low ? dutyLow + (int64_t)(dutyHigh - dutyLow) * (speed - low) / (high - low) : dutyLow;
+        dutyQ16[i] = max(duty, (int32_t)stallPercent << 16);
+    }
+}
+
+int32_t FanCurve::dutyForRPMQ16(int speed) const
+{
+    if (speed <= lowestRPM)
+    {
+        return (int32_t)stallPercent << 16;
+    }
+    if (speed >= highestRPM)
+    {
+        return (int32_t)100 << 16;
+    }
+
+    int32_t span = highestRPM - lowestRPM;
+    int32_t scaled = (int32_t)(speed - lowestRPM) * (FAN_CURVE_INVERSE_POINTS - 1);
+    int index = scaled / span;
+    int32_t fraction = scaled % span;
+    return dutyQ16[index] + (int64_t)(dutyQ16[index + 1] - dutyQ16[index]) * fraction / span;
+}
+
+int FanCurve::rpmForDuty(int percent) const
+{
+    percent = constrain(percent, 0, 100);
+    int point = min(percent * (FAN_CURVE_POINTS - 1) / 100, FAN_CURVE_POINTS - 2);
+    int dutyLow = dutyOfPoint(point);
+    int dutyHigh = dutyOfPoint(point + 1);
+    return rpm[point] + (int32_t)(rpm[point + 1] - rpm[point]) * (percent - dutyLow) / (dutyHigh - dutyLow);
+}
@@ -0,0 +1,60 @@
+#pragma once
+#ifndef FAN_CURVE_H
+#define FAN_CURVE_H
+
+#include <Arduino.h>
+
+#define FAN_CURVE_POINTS 21             // measured speeds, at duties 0%, 5% .. 100%
+#define FAN_CURVE_INVERSE_POINTS 32     // duties, at evenly spaced speeds, for dutyForRPM()
+#define FAN_CURVE_TEXT_LENGTH 160       // longest the curve can be as text
+
+// A fan's measured speed against its duty, from a calibration sweep
+// (see FanPWM::calibrate()), with the duty it stops below and the duty
+// it needs to start from standstill.
+//
+// It is kept in the settings as text, "stall,start,rpm,rpm,...", one
+// speed per FAN_CURVE_POINTS duty step. Loading it also works out the
+// inverse, the duty for each of FAN_CURVE_INVERSE_POINTS evenly spaced
+// speeds from the slowest measured running speed to the fastest, so
+// the duty for a speed is an index and one interpolation.
+class FanCurve
+{
+    private:
+        bool valid = false;
+        byte stallPercent = 0;
+        byte startPercent = 0;
+        uint16_t rpm[FAN_CURVE_POINTS] = {};
+
+        // the inverse, in percents of duty with 16 fractional bits
+        uint16_t lowestRPM = 0;
+        uint16_t highestRPM = 0;
+        int32_t dutyQ16[FAN_CURVE_INVERSE_POINTS] = {};
+
+    public:
+        // from the settings' text, false (and not valid) if it isn't a curve
+        bool parse(const char *text);
+        size_t format(char *buffer, size_t size) const;
+
+        // from a sweep, speeds are made to only rise with the duty
+        void set(byte stall, byte start, const uint16_t *measured);
+
+        bool isValid() const { return valid; }
+        byte getStallPercent() const { return stallPercent; }
+        byte getStartPercent() const { return startPercent; }
+        uint16_t getMaxRPM() const { return highestRPM; }
+        uint16_t getMinRPM() const { return lowestRPM; }
+
+        // the duty expected to hold the fan at speed, the stall duty for
+        // anything slower than it runs and 100% for anything faster
+        int32_t dutyForRPMQ16(int speed) const;
+
+        // the speed at a duty, for the log
+        int rpmForDuty(int percent) const;
+
+        static int dutyOfPoint(int point) { return point * 100 / (FAN_CURVE_POINTS - 1); }
+
+    private:
+        void buildInverse();
+};
+
+#endif // FAN_CURVE_H
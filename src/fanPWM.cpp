@@ -1,28 +1,61 @@
 #include "fanController.h"
 #include "fanPWM.h"
+#include <charconv>
 
-#define FAN_LOOP_INTERVAL_MILLIS 200    // 5 times a second
+#define FAN_REPORT_DEADLINE_MILLIS 200
 #define FAN_REPORT_TO_MQTT_INTERVAL_MILLIS 5000  // every 5 second
 
+static_assert(settingsSchemaValid(FanPWMSettings::startSpeed, FanPWMSettings::fanPin, FanPWMSettings::relayPin,
+                                  FanPWMSettings::maxRPM, FanPWMSettings::minPercent, FanPWMSettings::minStartPercent,
+                                  FanPWMSettings::pmwFrequency, FanPWMSettings::pmwChannel, FanPWMSettings::pmwResolution,
+                                  FanPWMSettings::stateMessage, FanPWMSettings::legacyTopics,
+                                  FanPWMSettings::stateDeadband, FanPWMSettings::stateHeartbeat,
+                                  FanPWMSettings::rampRate, FanPWMSettings::rpmRampRate,
+                                  FanPWMSettings::rpmKp, FanPWMSettings::rpmKi, FanPWMSettings::rpmCurve),
+              "FanPWM settings: a default is out of range or two names have the same id");
+
 
 FanPWM::FanPWM(SettingsManager& settingsManager)
     : ModuleBase(FAN_PWM_MODULE_NAME, FAN_PWM_MODULE_VERSION, settingsManager)
 {
-    settings.addSetting("startSpeed", new Setting<short>(DEFAULT_POWER_ON_SPEED));
-    settings.addSetting("fanPin", new Setting<byte>(DEFAULT_PWM_PIN));
-    settings.addSetting("relayPin", new Setting<byte>(DEFAULT_RELAY_PIN));
-
-    settings.addSetting("maxRPM", new Setting<int>(DEFAULT_MAX_RPM));
-    settings.addSetting("minPercent", new Setting<byte>(DEFAULT_MIN_PERCENT));
-    settings.addSetting("minStartPercent", new Setting<byte>(MIN_START_PERCENT));
+    startSpeedSetting = settings.addSetting(FanPWMSettings::startSpeed);
+    fanPinSetting = settings.addSetting(FanPWMSettings::fanPin);
+    relayPinSetting = settings.addSetting(FanPWMSettings::relayPin);
+
+    maxRPMSetting = settings.addSetting(FanPWMSettings::maxRPM);
+    minPercentSetting = settings.addSetting(FanPWMSettings::minPercent);
+    minStartPercentSetting = settings.addSetting(FanPWMSettings::minStartPercent);
+
+    pmwFrequencySetting = settings.addSetting(FanPWMSettings::pmwFrequency);
+    pmwChannelSetting = settings.addSetting(FanPWMSettings::pmwChannel);
+    pmwResolutionSetting = settings.addSetting(FanPWMSettings::pmwResolution);
+
+    stateMessageSetting = settings.addSetting(FanPWMSettings::stateMessage);
+    legacyTopicsSetting = settings.addSetting(FanPWMSettings::legacyTopics);
+    stateDeadbandSetting = settings.addSetting(FanPWMSettings::stateDeadband);
+    stateHeartbeatSetting = settings.addSetting(FanPWMSettings::stateHeartbeat);
+
+    rampRateSetting = settings.addSetting(FanPWMSettings::rampRate);
+    rpmRampRateSetting = settings.addSetting(FanPWMSettings::rpmRampRate);
+    rpmKpSetting = settings.addSetting(FanPWMSettings::rpmKp);
+    rpmKiSetting = settings.addSetting(FanPWMSettings::rpmKi);
+    rpmCurveSetting = settings.addSetting(FanPWMSettings::rpmCurve);
+}
 
-    settings.addSetting("pmwFrequency", new Setting<int>(PWM_FREQ));
-    settings.addSetting("pmwChannel", new Setting<byte>(PWM_CHANNEL));
-    settings.addSetting("pmwResolution", new Setting<byte>(PWM_RESOLUTION));
+// a gain in millionths of a percent to Q16 percent
+static int32_t gainToQ16(int gain)
+{
+    return ((int64_t)gain << 16) / 1000000;
+}
 
-    #ifdef ENABLE_MQTT
-    MQTT.registerCallback("fan", std::bind(&FanPWM::handleCommands, this, std::placeholders::_1, std::placeholders::_2));
-    #endif
+static const char *controlModeName(FanControlMode mode)
+{
+    switch (mode)
+    {
+        case FAN_CONTROL_RPM: return "rpm";
+        case FAN_CONTROL_CALIBRATE: return "calibrate";
+        default: return "percent";
+    }
 }
 
 FanPWM::~FanPWM()
@@ -31,69 +64,225 @@ FanPWM::~FanPWM()
 
 void FanPWM::setup()
 {
-    short startSpeed = settings.getValue<short>("startSpeed");
-    byte fanpin = settings.getValue<byte>("fanPin");
-    byte relayPin = settings.getValue<byte>("relayPin");
-
-    int pmwFrequency = settings.getValue<int>("pmwFrequency");
-    byte pmwChannel = settings.getValue<byte>("pmwChannel");
-    byte pmwResolution = settings.getValue<byte>("pmwResolution");
+    fanPin = fanPinSetting->get();
+    relayPin = relayPinSetting->get();
+    minPercent = minPercentSetting->get();
+    minStartPercent = minStartPercentSetting->get();
+    pwmFrequency = pmwFrequencySetting->get();
+    pwmChannel = pmwChannelSetting->get();
+    pwmResolution = pmwResolutionSetting->get();
+    kpQ16 = gainToQ16(rpmKpSetting->get());
+    kiQ16 = gainToQ16(rpmKiSetting->get());
+    loadCurve(rpmCurveSetting->get());
+    subscribeToSettings();
 
     // setup relay pin, start with it off
     pinMode(relayPin, OUTPUT);
     digitalWrite(relayPin, LOW);
 
-    // configure LED PWM functionalitites
-    ledcSetup(pmwChannel, pmwFrequency, pmwResolution);
+    applyPWMConfig();
+
+    // without the fade interrupt a speed change is a step
+    if (ledc_fade_func_install(0) != ESP_OK)
+    {
+        Log.println("ERROR! FANPWM: LEDC fades not available, speed changes won't ramp");
+    }
+    rampJob = scheduler.addOneShot("fan.ramp", FAN_FADE_SEGMENT_MILLIS, FAN_FADE_SEGMENT_MILLIS / 10,
+                                   std::bind(&FanPWM::chaseTargetSpeed, this));
 
-    // attach the channel to the GPIO to be controlled
-    ledcAttachPin(fanpin, pmwChannel);
+    setSpeed(startSpeedSetting->get());
+
+    scheduler.addPeriodic("fan.rpm", FAN_RPM_CONTROL_PERIOD_MILLIS, FAN_RPM_CONTROL_PERIOD_MILLIS / 4,
+                          std::bind(&FanPWM::controlRPM, this));
+
+#ifdef ENABLE_MQTT
+    scheduler.addPeriodic("fan.report", FAN_REPORT_TO_MQTT_INTERVAL_MILLIS, FAN_REPORT_DEADLINE_MILLIS,
+                          std::bind(&FanPWM::reportToMQTT, this));
+#endif
 
-    setSpeed(startSpeed);
+    // registered here rather than in the constructor, the MQTT callback table
+    // is a static in another translation unit and may not be constructed yet
+    #ifdef ENABLE_MQTT
+    MQTT.registerCallback("fan", std::bind(&FanPWM::handleCommands, this, std::placeholders::_1, std::placeholders::_2));
+    #endif
 }
 
 
 void FanPWM::loop()
 {
-    //only every 100ms
-    static unsigned long chaseTargetSpeedMillis = 0;
-    if (millis() - chaseTargetSpeedMillis > FAN_LOOP_INTERVAL_MILLIS)
+    // nothing to poll, the ramp and MQTT report are scheduled jobs
+}
+
+
+// A changed pin or PWM setting is applied straight away, the fan keeps
+// its speed
+void FanPWM::subscribeToSettings()
+{
+    fanPinSetting->onChange([this](const byte &pin) {
+        fanPin = pin;
+        applyPWMConfig();
+    });
+
+    relayPinSetting->onChange([this](const byte &pin) {
+        digitalWrite(relayPin, LOW);
+        relayPin = pin;
+        pinMode(relayPin, OUTPUT);
+        digitalWrite(relayPin, isRunning ? HIGH : LOW);
+        Log.printfln("FANPWM: relay now on pin %u", relayPin);
+    });
+
+    minPercentSetting->onChange([this](const byte &percent) { minPercent = percent; });
+    minStartPercentSetting->onChange([this](const byte &percent) { minStartPercent = percent; });
+
+    pmwFrequencySetting->onChange([this](const int &frequency) {
+        pwmFrequency = frequency;
+        applyPWMConfig();
+    });
+
+    pmwChannelSetting->onChange([this](const byte &channel) {
+        pwmChannel = channel;
+        applyPWMConfig();
+    });
+
+    pmwResolutionSetting->onChange([this](const byte &bits) {
+        pwmResolution = bits;
+        applyPWMConfig();
+    });
+
+    rpmKpSetting->onChange([this](const int &gain) { kpQ16 = gainToQ16(gain); });
+    rpmKiSetting->onChange([this](const int &gain) { kiQ16 = gainToQ16(gain); });
+    rpmCurveSetting->onChange([this](const String &text) { loadCurve(text); });
+}
+
+void FanPWM::loadCurve(const String &text)
+{
+    if (text.length() == 0)
+    {
+        curve = FanCurve();
+        return;
+    }
+    if (!curve.parse(text.c_str()))
+    {
+        Log.println("FANPWM: rpmCurve is not a calibration curve, ignored");
+        return;
+    }
+    Log.printfln("FANPWM: calibration curve %u-%u rpm, stops below %u%%, starts at %u%%",
+                 curve.getMinRPM(), curve.getMaxRPM(), curve.getStallPercent(), curve.getStartPercent());
+}
+
+
+// (re)configures the LEDC channel, attaches the fan pin to it and
+// writes the duty for the current speed. A fade can't be stopped, so a
+// change while one runs is applied by chaseTargetSpeed() when it ends.
+void FanPWM::applyPWMConfig()
+{
+    if (fading)
     {
-        chaseTargetSpeedMillis = millis();
+        pwmConfigPending = true;
+        return;
+    }
+    pwmConfigPending = false;
 
-        // If targetSpeedPercent is not the same as CurrentSpeedPercent
-        // then we need to move Current towards the target but dio it over
-        // a number of loop
-        if (targetSpeedPercent != currentSpeedPercent)
+    if (ledcSetup(pwmChannel, pwmFrequency, pwmResolution) == 0)
+    {
+        Log.printfln("ERROR! FANPWM: %u Hz at %u bits is not possible on channel %u",
+                     pwmFrequency, pwmResolution, pwmChannel);
+        return;
+    }
+    if (pwmPinAttached)
+    {
+        ledcDetachPin(attachedPin);
+    }
+    ledcAttachPin(fanPin, pwmChannel);
+    attachedPin = fanPin;
+    pwmPinAttached = true;
+    ledcWrite(pwmChannel, getPWMValue(currentSpeedPercent));
+
+    Log.printfln("FANPWM: PWM on pin %u, channel %u, %u Hz, %u bits", fanPin, pwmChannel, pwmFrequency, pwmResolution);
+}
+
+
+// Runs when a fade ends, and from setSpeed(). Applies PWM settings and
+// writes a duty held back by the fade, then fades on towards the target
+// at rampRate, at most FAN_FADE_SEGMENT_MILLIS at a time so a new target
+// isn't kept waiting long. Nothing runs while the hardware fades.
+void FanPWM::chaseTargetSpeed()
+{
+    if (fading)
+    {
+        if ((long)(millis() - fadeEndsMillis) < 0)
         {
-            if (currentSpeedPercent < targetSpeedPercent)
-            {
-                currentSpeedPercent++;
-            }
-            else
-            {
-                currentSpeedPercent--;
-            }
+            return;     // still fading, this fade's end will come round
+        }
+        fading = false;
+        if (isRunning && controlMode == FAN_CONTROL_PERCENT)
+        {
+            currentSpeedPercent = fadeTargetPercent;
+        }
+    }
+    if (pwmConfigPending)
+    {
+        applyPWMConfig();
+    }
+    if (dutyPending)
+    {
+        dutyPending = false;
+        setDutyQ16(pendingDutyQ16);
+    }
 
-            int pwmValue = getPWMValue(currentSpeedPercent);
-            ledcWrite(PWM_CHANNEL, pwmValue);
+    if (controlMode != FAN_CONTROL_PERCENT || !isRunning)
+    {
+        return;
+    }
+
+    if (targetSpeedPercent != currentSpeedPercent)
+    {
+        int rate = rampRateSetting->get();
+        int remaining = abs((int)targetSpeedPercent - (int)currentSpeedPercent);
+        int step = rate > 0 ? min(remaining, max(rate * FAN_FADE_SEGMENT_MILLIS / 1000, 1)) : remaining;
+        byte next = targetSpeedPercent > currentSpeedPercent ? currentSpeedPercent + step : currentSpeedPercent - step;
+
+        if (rate == 0 || !fadeTo(next, step * 1000 / rate))
+        {
+            currentSpeedPercent = targetSpeedPercent;
+            setDutyQ16((int32_t)currentSpeedPercent << 16);
         }
     }
 
 #ifdef ENABLE_MQTT
-    static unsigned long reportToMqttMillis = 0;
-    if (millis() - reportToMqttMillis > FAN_REPORT_TO_MQTT_INTERVAL_MILLIS)
+    publishStateIfChanged();
+#endif
+}
+
+// starts the hardware fade to percent, and the job for its end
+bool FanPWM::fadeTo(byte percent, uint32_t fadeMillis)
+{
+    // Arduino's channels 0-7 are the high speed group's, 8-15 the low speed group's
+    ledc_mode_t group = (ledc_mode_t)(pwmChannel / 8);
+    ledc_channel_t channel = (ledc_channel_t)(pwmChannel % 8);
+    if (ledc_set_fade_with_time(group, channel, getPWMValue(percent), fadeMillis) != ESP_OK ||
+        ledc_fade_start(group, channel, LEDC_FADE_NO_WAIT) != ESP_OK)
     {
-        reportToMqttMillis = millis();
-        reportToMQTT();
+        return false;
     }
-#endif
+
+    fading = true;
+    fadeTargetPercent = percent;
+    fadeEndsMillis = millis() + fadeMillis;
+    fades++;
+    scheduler.trigger(rampJob, fadeMillis);
+    return true;
 }
 
 
 void FanPWM::setSpeed(int requestedSpeedPercent)
 {
-    byte relayPin = settings.getValue<byte>("relayPin");
+    if (controlMode == FAN_CONTROL_CALIBRATE)
+    {
+        Log.println("FANPWM: calibration abandoned for setSpeed");
+        endCalibration();
+    }
+    controlMode = FAN_CONTROL_PERCENT;
 
     if (requestedSpeedPercent == 0 && isRunning)
     {
@@ -107,24 +296,18 @@ void FanPWM::setSpeed(int requestedSpeedPercent)
         return;
     }
 
-    uint8_t minPercent = settings.getValue<byte>("minPercent");
-
     targetSpeedPercent = min(requestedSpeedPercent, 100);
     if (targetSpeedPercent < minPercent)
     {
         targetSpeedPercent = minPercent;
     }
 
-    if (isRunning) {
-        currentSpeedPercent = targetSpeedPercent;
-    }
-    else {
+    // a running fan ramps from where it is
+    if (!isRunning) {
         // Not running, lets start it up
         isRunning = true;
         digitalWrite(relayPin, HIGH);
 
-        uint8_t minStartPercent = settings.getValue<byte>("minStartPercent");
-
         if (targetSpeedPercent < minStartPercent)
         {
             currentSpeedPercent = minStartPercent;
@@ -132,6 +315,10 @@ void FanPWM::setSpeed(int requestedSpeedPercent)
         else {
             currentSpeedPercent = targetSpeedPercent;
         }
+
+        int pwmValue = getPWMValue(currentSpeedPercent);
+        Log.printfln("FANPWM:setSpeed - Setting fan speed to %u%% (%u)", currentSpeedPercent, pwmValue);
+        setDutyQ16((int32_t)currentSpeedPercent << 16);
     }
 
 
@@ -141,10 +328,446 @@ void FanPWM::setSpeed(int requestedSpeedPercent)
     reportToMQTT();
 #endif  
 
-    int pwmValue = getPWMValue(currentSpeedPercent);
+    chaseTargetSpeed();
+}
+
+
+void FanPWM::setRPM(int rpm)
+{
+    if (rpm <= 0)
+    {
+        setSpeed(0);
+        return;
+    }
+    if (controlMode == FAN_CONTROL_CALIBRATE)
+    {
+        Log.println("FANPWM: calibration abandoned for setRPM");
+        endCalibration();
+    }
+    rpm = min(rpm, maxRPMSetting->get());
+
+    // with a ramp rate the setpoint moves there from the current one,
+    // or from the fan's speed
+    if (rpmRampRateSetting->get() == 0)
+    {
+        setpointRPM = rpm;
+    }
+    else if (controlMode != FAN_CONTROL_RPM || !isRunning)
+    {
+        setpointRPM = Tacho.getRPM();
+    }
+
+    int32_t feedForward = feedForwardQ16(setpointRPM);
+    if (!isRunning)
+    {
+        isRunning = true;
+        digitalWrite(relayPin, HIGH);
+        integralQ16 = 0;
+        outputQ16 = max(feedForward, (int32_t)minStartPercent << 16);
+    }
+    else if (controlMode != FAN_CONTROL_RPM)
+    {
+        // carries on from the current duty rather than jumping to the
+        // feed-forward's
+        integralQ16 = ((int32_t)currentSpeedPercent << 16) - feedForward;
+        outputQ16 = (int32_t)currentSpeedPercent << 16;
+    }
+    else
+    {
+        // the integral stays, the feed-forward makes the step
+        outputQ16 = constrain(feedForward + integralQ16, (int32_t)minPercent << 16, (int32_t)100 << 16);
+    }
+
+    controlMode = FAN_CONTROL_RPM;
+    targetRPM = rpm;
+    targetChangedMillis = millis();
+    settled = false;
+    periodsInBand = 0;
+    settledErrorSum = 0;
+    settledErrorSquares = 0;
+    settledPeriods = 0;
+
+    writeDutyQ16(outputQ16);
+    Log.printfln("FANPWM:setRPM - target %d rpm, duty %.2f%%", targetRPM, outputQ16 / 65536.0);
+
+#ifdef ENABLE_MQTT
+    reportToMQTT();
+#endif
+}
+
+// the duty expected to hold rpm, from the calibration curve if there
+// is one, otherwise a straight line from minPercent at standstill to
+// 100% at maxRPM. The PI controller corrects the rest.
+int32_t FanPWM::feedForwardQ16(int rpm) const
+{
+    if (curve.isValid())
+    {
+        return curve.dutyForRPMQ16(rpm);
+    }
+
+    int maxRPM = max(maxRPMSetting->get(), 1);
+    int32_t span = (int32_t)(100 - minPercent) << 16;
+    return ((int32_t)minPercent << 16) + (int64_t)span * min(rpm, maxRPM) / maxRPM;
+}
+
+// the duty from the RPM controller or the calibration, which the
+// speed reports follow
+void FanPWM::writeDutyQ16(int32_t percentQ16)
+{
+    setDutyQ16(percentQ16);
+
+    currentSpeedPercent = (percentQ16 + (1 << 15)) >> 16;
+    targetSpeedPercent = currentSpeedPercent;
+}
+
+// writes the duty, or holds it until the fade under way ends, as
+// ledcWrite() would wait for it
+void FanPWM::setDutyQ16(int32_t percentQ16)
+{
+    if (fading)
+    {
+        pendingDutyQ16 = percentQ16;
+        dutyPending = true;
+        deferredWrites++;
+        return;
+    }
 
-    Log.printfln("FANPWM:setSpeed - Setting fan speed to %u%% (%u)", currentSpeedPercent, pwmValue);
-    ledcWrite(PWM_CHANNEL, pwmValue);
+    uint32_t maxValue = (1UL << pwmResolution) - 1;
+    ledcWrite(pwmChannel, ((int64_t)percentQ16 * maxValue) / (100 << 16));
+}
+
+// one period of the PI controller. The integral is left alone while
+// the output is at a limit and the error would push it further, so it
+// doesn't wind up while the fan can't follow.
+void FanPWM::controlRPM()
+{
+    if (controlMode != FAN_CONTROL_RPM || !isRunning)
+    {
+        return;
+    }
+    controlPeriods++;
+
+    int rampRate = rpmRampRateSetting->get();
+    if (rampRate == 0)
+    {
+        setpointRPM = targetRPM;
+    }
+    else
+    {
+        int maxStep = max(rampRate * FAN_RPM_CONTROL_PERIOD_MILLIS / 1000, 1);
+        setpointRPM += constrain(targetRPM - setpointRPM, -maxStep, maxStep);
+    }
+
+    int measured = Tacho.getRPM();
+    int32_t error = setpointRPM - measured;
+
+    const int32_t lowest = (int32_t)minPercent << 16;
+    const int32_t highest = (int32_t)100 << 16;
+    int32_t feedForward = feedForwardQ16(setpointRPM);
+    int32_t proportional = constrain((int64_t)kpQ16 * error, -highest, highest);
+    int32_t integral = constrain(integralQ16 + (int64_t)kiQ16 * error, -highest, highest);
+
+    int32_t output = feedForward + proportional + integral;
+    if ((output > highest && error > 0) || (output < lowest && error < 0))
+    {
+        saturatedPeriods++;
+        output = feedForward + proportional + integralQ16;
+    }
+    else
+    {
+        integralQ16 = integral;
+    }
+    outputQ16 = constrain(output, lowest, highest);
+    writeDutyQ16(outputQ16);
+
+    // settled once the speed has stayed near the target for a few
+    // periods, timed from the first of them
+    error = targetRPM - measured;
+    int32_t band = max(targetRPM * FAN_RPM_SETTLED_PERCENT / 100, FAN_RPM_SETTLED_MIN_RPM);
+    if (!settled)
+    {
+        periodsInBand = abs(error) <= band ? periodsInBand + 1 : 0;
+        if (periodsInBand >= FAN_RPM_SETTLED_PERIODS)
+        {
+            settled = true;
+            settles++;
+            settlingMillis = millis() - targetChangedMillis - (FAN_RPM_SETTLED_PERIODS - 1) * FAN_RPM_CONTROL_PERIOD_MILLIS;
+            maxSettlingMillis = max(maxSettlingMillis, settlingMillis);
+        }
+    }
+    else
+    {
+        settledErrorSum += error;
+        settledErrorSquares += (int64_t)error * error;
+        settledPeriods++;
+    }
+
+#ifdef ENABLE_MQTT
+    publishStateIfChanged();
+#endif
+}
+
+
+void FanPWM::calibrate()
+{
+    if (controlMode == FAN_CONTROL_CALIBRATE)
+    {
+        Log.println("FANPWM: already calibrating");
+        return;
+    }
+
+    modeBeforeCalibration = controlMode;
+    runningBeforeCalibration = isRunning;
+    speedBeforeCalibration = targetSpeedPercent;
+    rpmBeforeCalibration = targetRPM;
+
+    controlMode = FAN_CONTROL_CALIBRATE;
+    if (!isRunning)
+    {
+        isRunning = true;
+        digitalWrite(relayPin, HIGH);
+    }
+
+    memset(calibrationRPM, 0, sizeof(calibrationRPM));
+    calibrationPhase = FAN_CALIBRATION_SWEEP;
+    calibrationPoint = FAN_CURVE_POINTS - 1;
+    calibrationStall = 0;
+    calibrationStartedMillis = millis();
+    setCalibrationDuty(100);
+
+    if (calibrationJob < 0)
+    {
+        calibrationJob = scheduler.addOneShot("fan.calibrate", FAN_CALIBRATION_SAMPLE_MILLIS, FAN_CALIBRATION_SAMPLE_MILLIS / 2,
+                                              std::bind(&FanPWM::calibrationStep, this));
+    }
+    else
+    {
+        scheduler.trigger(calibrationJob, FAN_CALIBRATION_SAMPLE_MILLIS);
+    }
+
+    Log.println("FANPWM: calibrating, sweeping the duty down from 100%");
+}
+
+// one tacho reading. The sweep takes the speed at each of the curve's
+// duty steps from the top down. Once the fan stops it is run up to full
+// speed again and brought down 1% at a time to find the duty it stops
+// below, then from standstill up 1% at a time to find the duty it
+// starts from.
+void FanPWM::calibrationStep()
+{
+    if (controlMode != FAN_CONTROL_CALIBRATE)
+    {
+        return;
+    }
+
+    // a reading the tacho hasn't updated since doesn't count towards
+    // settling, a coasting fan's last speed can stand for a second
+    int reading = Tacho.getRPM();
+    uint32_t updates = Tacho.getUpdates();
+    bool stepSettled = updates != lastTachoUpdates ? calibrationSettled(reading) : calibrationTimedOut();
+    lastTachoUpdates = updates;
+
+    switch (calibrationPhase)
+    {
+        case FAN_CALIBRATION_SWEEP:
+            if (!stepSettled)
+            {
+                break;
+            }
+            calibrationRPM[calibrationPoint] = reading;
+            if (reading == 0 && calibrationPoint == FAN_CURVE_POINTS - 1)
+            {
+                abortCalibration("no speed at 100%, is the tacho connected?");
+                return;
+            }
+            if (reading == 0)
+            {
+                calibrationPhase = FAN_CALIBRATION_KICK;
+                setCalibrationDuty(100);
+            }
+            else if (calibrationPoint == 0)
+            {
+                // turns even at 0%
+                finishCalibration(0, 0);
+                return;
+            }
+            else
+            {
+                calibrationPoint--;
+                setCalibrationDuty(FanCurve::dutyOfPoint(calibrationPoint));
+            }
+            break;
+
+        case FAN_CALIBRATION_KICK:
+            if (stepSettled)
+            {
+                // it ran at the step above the one it stopped at
+                calibrationPhase = FAN_CALIBRATION_STALL;
+                setCalibrationDuty(FanCurve::dutyOfPoint(calibrationPoint + 1) - 1);
+            }
+            break;
+
+        case FAN_CALIBRATION_STALL:
+            if (!stepSettled)
+            {
+                break;
+            }
+            if (reading == 0)
+            {
+                calibrationStall = calibrationDuty + 1;
+                calibrationPhase = FAN_CALIBRATION_START;
+                setCalibrationDuty(calibrationStall);
+            }
+            else if (calibrationDuty == 0)
+            {
+                finishCalibration(0, 0);
+                return;
+            }
+            else
+            {
+                setCalibrationDuty(calibrationDuty - 1);
+            }
+            break;
+
+        case FAN_CALIBRATION_START:
+            if (reading > 0)
+            {
+                finishCalibration(calibrationStall, calibrationDuty);
+                return;
+            }
+            if (!stepSettled)
+            {
+                break;
+            }
+            if (calibrationDuty >= 100)
+            {
+                abortCalibration("it didn't start again");
+                return;
+            }
+            setCalibrationDuty(calibrationDuty + 1);
+            break;
+    }
+
+    scheduler.trigger(calibrationJob, FAN_CALIBRATION_SAMPLE_MILLIS);
+}
+
+// settled once FAN_CALIBRATION_STABLE_READINGS readings in a row are
+// within FAN_CALIBRATION_STABLE_PERCENT of each other, or the step has
+// timed out. A reading outside that starts the run again from itself.
+bool FanPWM::calibrationSettled(int reading)
+{
+    int lowest = min(reading, runLowestRPM);
+    int highest = max(reading, runHighestRPM);
+    if (runReadings == 0 || highest - lowest > max(lowest * FAN_CALIBRATION_STABLE_PERCENT / 100, FAN_CALIBRATION_STABLE_RPM))
+    {
+        lowest = highest = reading;
+        runReadings = 0;
+    }
+    runLowestRPM = lowest;
+    runHighestRPM = highest;
+    runReadings++;
+
+    return runReadings >= FAN_CALIBRATION_STABLE_READINGS || calibrationTimedOut();
+}
+
+bool FanPWM::calibrationTimedOut() const
+{
+    return millis() - stepStartedMillis >= FAN_CALIBRATION_STEP_TIMEOUT_MILLIS;
+}
+
+void FanPWM::setCalibrationDuty(byte percent)
+{
+    calibrationDuty = percent;
+    outputQ16 = (int32_t)percent << 16;
+    writeDutyQ16(outputQ16);
+
+    runReadings = 0;
+    stepStartedMillis = millis();
+}
+
+void FanPWM::finishCalibration(byte stall, byte start)
+{
+    curve.set(stall, start, calibrationRPM);
+    if (!curve.isValid())
+    {
+        abortCalibration("the speeds measured don't rise with the duty");
+        return;
+    }
+    calibrations++;
+    calibrationMillis = millis() - calibrationStartedMillis;
+
+    char text[FAN_CURVE_TEXT_LENGTH + 1];
+    curve.format(text, sizeof(text));
+
+    // the margins keep the fan clear of the thresholds, which drift
+    // with temperature and wear
+    byte lowest = stall > 0 ? min(stall + FAN_CALIBRATION_MARGIN_PERCENT, 100) : 0;
+    byte starting = start > 0 ? min(start + FAN_CALIBRATION_MARGIN_PERCENT, 100) : 0;
+    starting = max(starting, lowest);
+
+    Log.printfln("FANPWM: calibrated in %u ms, stops below %u%%, starts at %u%%, %u rpm at 100%%",
+                 calibrationMillis, stall, start, curve.getMaxRPM());
+    Log.printfln("FANPWM: curve %s", text);
+
+    rpmCurveSetting->setValue(String(text));
+    minPercentSetting->setValue(lowest);
+    minStartPercentSetting->setValue(starting);
+    maxRPMSetting->setValue(curve.getMaxRPM());
+
+#ifdef ENABLE_MQTT
+    JsonDocument doc;
+    doc["stallPercent"] = stall;
+    doc["startPercent"] = start;
+    doc["minPercent"] = lowest;
+    doc["minStartPercent"] = starting;
+    doc["maxRPM"] = curve.getMaxRPM();
+    doc["durationMillis"] = calibrationMillis;
+    JsonArray points = doc["rpm"].to<JsonArray>();
+    for (int i = 0; i < FAN_CURVE_POINTS; i++)
+    {
+        points.add(curve.rpmForDuty(FanCurve::dutyOfPoint(i)));
+    }
+    MQTT.publishJson("calibration", doc);
+#endif
+
+    restoreAfterCalibration();
+}
+
+// stops the sweep and puts the fan back as it was, the settings are untouched
+void FanPWM::abortCalibration(const char *reason)
+{
+    if (controlMode != FAN_CONTROL_CALIBRATE)
+    {
+        return;
+    }
+    calibrationFailures++;
+    Log.printfln("FANPWM: calibration failed, %s", reason);
+
+    restoreAfterCalibration();
+}
+
+void FanPWM::endCalibration()
+{
+    scheduler.cancel(calibrationJob);
+    controlMode = FAN_CONTROL_PERCENT;
+}
+
+// back to how the fan was before calibrate()
+void FanPWM::restoreAfterCalibration()
+{
+    endCalibration();
+    if (!runningBeforeCalibration)
+    {
+        setSpeed(0);
+    }
+    else if (modeBeforeCalibration == FAN_CONTROL_RPM)
+    {
+        setRPM(rpmBeforeCalibration);
+    }
+    else
+    {
+        setSpeed(speedBeforeCalibration);
+    }
 }
 
 
@@ -152,29 +775,49 @@ void FanPWM::getInfoForLog(Logger &log) const
 {
     ModuleBase::getInfoForLog(log);
 
-    byte relayPin = settings.getValue<byte>("relayPin");
-    byte fanPin = settings.getValue<byte>("fanPin");    
     log.printfln("Relay Pin: %u", relayPin);
     log.printfln("Relay GPIO: %s", digitalRead(relayPin) ? "HIGH" : "LOW");
     log.printfln("Fan Pin: %u", fanPin);
     log.printfln("Current Speed: %u%%", currentSpeedPercent);
     log.printfln("Target Speed: %u%%", targetSpeedPercent);
     log.printfln("Is Running: %s", isRunning ? "Yes" : "No");
-    log.printfln("PWM Value: %u", String(getPWMValue(currentSpeedPercent)));
-    log.printfln("PWM Resolution: %u", String(settings.getValue<byte>("pmwResolution")));
-    log.printfln("PWM Frequency: %u", String(settings.getValue<int>("pmwFrequency")));
-    log.printfln("PWM Channel: %u", String(settings.getValue<byte>("pmwChannel")));
+    log.printfln("PWM Value: %u", getPWMValue(currentSpeedPercent));
+    log.printfln("PWM Resolution: %u", pwmResolution);
+    log.printfln("PWM Frequency: %u", pwmFrequency);
+    log.printfln("PWM Channel: %u", pwmChannel);
+    log.printfln("Control: %s, target %d rpm, measured %d rpm, duty %.2f%%",
+                 controlModeName(controlMode), targetRPM, Tacho.getRPM(), outputQ16 / 65536.0);
+    log.printfln("Settling: last %u ms (%s), max %u ms, %u settles, steady state error %.1f rpm (rms %.1f)",
+                 settlingMillis, settled ? "settled" : "not settled", maxSettlingMillis, settles,
+                 settledPeriods > 0 ? (double)settledErrorSum / settledPeriods : 0.0,
+                 settledPeriods > 0 ? sqrt((double)settledErrorSquares / settledPeriods) : 0.0);
+    log.printfln("Control Periods: %u, %u saturated", controlPeriods, saturatedPeriods);
+    log.printfln("Ramp: %u%%/s, %d rpm/s, %u fades%s, %u writes held for a fade",
+                 rampRateSetting->get(), rpmRampRateSetting->get(), fades, fading ? " (fading)" : "", deferredWrites);
+    if (curve.isValid())
+    {
+        log.printfln("Curve: %u-%u rpm, stops below %u%%, starts at %u%%",
+                     curve.getMinRPM(), curve.getMaxRPM(), curve.getStallPercent(), curve.getStartPercent());
+    }
+    else
+    {
+        log.println("Curve: not calibrated");
+    }
+    log.printfln("Calibrations: %u, %u failed, last took %u ms%s", calibrations, calibrationFailures, calibrationMillis,
+                 controlMode == FAN_CONTROL_CALIBRATE ? ", one running" : "");
+#ifdef ENABLE_MQTT
+    log.printfln("State Message: %s, %u published, %u suppressed",
+                 stateMessageSetting->get() ? "Yes" : "No", statePublished, stateSuppressed);
+    log.printfln("Legacy Topics: %s", legacyTopicsSetting->get() ? "Yes" : "No");
+#endif
 
 
 }
 
-String FanPWM::getInfoForJson() const
+JsonDocument FanPWM::getInfoForJson() const
 {
     JsonDocument doc = startJsonDoc();
 
-    byte relayPin = settings.getValue<byte>("relayPin");
-    byte fanPin = settings.getValue<byte>("fanPin");
-    
     doc["relayPin"] = relayPin;
     doc["relayGPIO"] = digitalRead(relayPin) ? "HIGH" : "LOW";
     doc["fanPin"] = fanPin;
@@ -182,41 +825,148 @@ String FanPWM::getInfoForJson() const
     doc["targetSpeed"] = targetSpeedPercent;
     doc["isRunning"] = isRunning ? "Yes" : "No";
     doc["pwmValue"] = String(getPWMValue(currentSpeedPercent));
-    doc["pwmResolution"] = String(settings.getValue<byte>("pmwResolution"));    
-    doc["pwmFrequency"] = String(settings.getValue<int>("pmwFrequency"));
-    doc["pwmChannel"] = String(settings.getValue<byte>("pmwChannel"));
+    doc["pwmResolution"] = pwmResolution;
+    doc["pwmFrequency"] = pwmFrequency;
+    doc["pwmChannel"] = pwmChannel;
+
+    JsonObject ramp = doc["ramp"].to<JsonObject>();
+    ramp["percentPerSec"] = rampRateSetting->get();
+    ramp["rpmPerSec"] = rpmRampRateSetting->get();
+    ramp["fading"] = fading;
+    ramp["fades"] = fades;
+    ramp["deferredWrites"] = deferredWrites;
+
+    JsonObject control = doc["rpmControl"].to<JsonObject>();
+    control["mode"] = controlModeName(controlMode);
+    control["targetRPM"] = targetRPM;
+    control["setpointRPM"] = setpointRPM;
+    control["measuredRPM"] = Tacho.getRPM();
+    control["dutyPercent"] = outputQ16 / 65536.0;
+    control["feedForwardPercent"] = feedForwardQ16(targetRPM) / 65536.0;
+    control["integralPercent"] = integralQ16 / 65536.0;
+    control["settled"] = settled;
+    control["settlingMillis"] = settlingMillis;
+    control["maxSettlingMillis"] = maxSettlingMillis;
+    control["settles"] = settles;
+    control["steadyStateError"] = settledPeriods > 0 ? (double)settledErrorSum / settledPeriods : 0.0;
+    control["steadyStateErrorRms"] = settledPeriods > 0 ? sqrt((double)settledErrorSquares / settledPeriods) : 0.0;
+    control["periods"] = controlPeriods;
+    control["saturatedPeriods"] = saturatedPeriods;
+
+    JsonObject calibration = doc["calibration"].to<JsonObject>();
+    calibration["valid"] = curve.isValid();
+    calibration["stallPercent"] = curve.getStallPercent();
+    calibration["startPercent"] = curve.getStartPercent();
+    calibration["minRPM"] = curve.getMinRPM();
+    calibration["maxRPM"] = curve.getMaxRPM();
+    calibration["running"] = controlMode == FAN_CONTROL_CALIBRATE;
+    calibration["calibrations"] = calibrations;
+    calibration["failures"] = calibrationFailures;
+    calibration["lastMillis"] = calibrationMillis;
 
-    String jsonString;
-    serializeJson(doc, jsonString);
-    return jsonString;
+#ifdef ENABLE_MQTT
+    JsonObject state = doc["stateMessage"].to<JsonObject>();
+    state["enabled"] = stateMessageSetting->get();
+    state["legacyTopics"] = legacyTopicsSetting->get();
+    state["deadband"] = stateDeadbandSetting->get();
+    state["heartbeatSecs"] = stateHeartbeatSetting->get();
+    state["published"] = statePublished;
+    state["suppressed"] = stateSuppressed;
+#endif
+
+    return doc;
 }
 
 #ifdef ENABLE_MQTT
 void FanPWM::reportToMQTT()
 {
-    if (MQTT.getStatus() == MQTT_CONNECTED)
+    // queued while disconnected, only the latest values are kept
+    if (legacyTopicsSetting->get())
     {
-        MQTT.publish("currentSpeed", String(currentSpeedPercent));
-        MQTT.publish("targetSpeed", String(targetSpeedPercent));
-        MQTT.publish("isRunning", String(isRunning));
+        MQTT.publishInt("currentSpeed", currentSpeedPercent);
+        MQTT.publishInt("targetSpeed", targetSpeedPercent);
+        MQTT.publishInt("isRunning", isRunning);
     }
+
+    publishStateIfChanged();
+}
+
+void FanPWM::publishStateIfChanged()
+{
+    if (!stateMessageSetting->get())
+    {
+        return;
+    }
+
+    // the ramp moves the current speed one hardware fade segment at a
+    // time (rampRate's worth of FAN_FADE_SEGMENT_MILLIS), so only report
+    // it once it has moved by the deadband, or has reached the target
+    byte deadband = stateDeadbandSetting->get();
+    int currentDelta = abs((int)currentSpeedPercent - (int)reportedCurrentPercent);
+    bool currentChanged = currentDelta > 0 &&
+                          (currentDelta >= deadband || currentSpeedPercent == targetSpeedPercent);
+
+    unsigned long heartbeatMillis = (unsigned long)stateHeartbeatSetting->get() * 1000;
+    bool heartbeatDue = heartbeatMillis > 0 && millis() - stateReportedMillis >= heartbeatMillis;
+
+    if (stateReported && !heartbeatDue && !currentChanged &&
+        targetSpeedPercent == reportedTargetPercent && isRunning == reportedRunning)
+    {
+        stateSuppressed++;
+        return;
+    }
+
+    char payload[48];
+    snprintf(payload, sizeof(payload), "{\"current\":%u,\"target\":%u,\"running\":%s}",
+             currentSpeedPercent, targetSpeedPercent, isRunning ? "true" : "false");
+
+    // retained, so a subscriber gets the current state straight away
+    // rather than waiting for the next change or heartbeat
+    MQTT.publish("state", payload, true);
+
+    reportedCurrentPercent = currentSpeedPercent;
+    reportedTargetPercent = targetSpeedPercent;
+    reportedRunning = isRunning;
+    stateReported = true;
+    stateReportedMillis = millis();
+    statePublished++;
 }
 #endif
 
-void FanPWM::handleCommands(const String& command, const String& payload)
+void FanPWM::handleCommands(std::string_view command, std::string_view payload)
 {
-    Log.printfln("FANPWM:handleCommands - command %s, payload %s", command, payload);
+    Log.printfln("FANPWM:handleCommands - command %.*s, payload %.*s",
+                 (int)command.size(), command.data(), (int)payload.size(), payload.data());
 
     if (command == "setSpeed")
     {
-        setSpeed(payload.toInt());
+        // like String::toInt(), anything that isn't a number is 0
+        int speed = 0;
+        std::from_chars(payload.data(), payload.data() + payload.size(), speed);
+        setSpeed(speed);
+    }
+    else if (command == "setRPM")
+    {
+        int rpm = 0;
+        std::from_chars(payload.data(), payload.data() + payload.size(), rpm);
+        setRPM(rpm);
+    }
+    else if (command == "calibrate")
+    {
+        if (payload == "abort")
+        {
+            abortCalibration("aborted");
+        }
+        else
+        {
+            calibrate();
+        }
     }
 }
 
 int FanPWM::getPWMValue(int speedPercent) const
 {
-    byte pmwResolution = settings.getValue<byte>("pmwResolution");
-    int maxValue = (1 << pmwResolution) - 1;
+    int maxValue = (1 << pwmResolution) - 1;
     int pwmValue = (speedPercent * maxValue) / 100;
     return pwmValue;
 }
@@ -8,10 +8,56 @@
 #include <Arduino.h>
 #include <esp32-hal.h>
 #include <esp32-hal-ledc.h>
+#include <driver/ledc.h>
+#include <string_view>
 
 #include "config.h"
 #include "settings.h"
 #include "modules/moduleBase.h"
+#include "fanCurve.h"
+
+// the FanPWM settings, see settings/settingSpec.h
+namespace FanPWMSettings
+{
+    inline constexpr SettingSpec<short> startSpeed("startSpeed", DEFAULT_POWER_ON_SPEED, 0, 100);
+    inline constexpr SettingSpec<byte> fanPin("fanPin", DEFAULT_PWM_PIN, 0, 39);
+    inline constexpr SettingSpec<byte> relayPin("relayPin", DEFAULT_RELAY_PIN, 0, 39);
+
+    inline constexpr SettingSpec<int> maxRPM("maxRPM", DEFAULT_MAX_RPM, 0, 30000);
+    inline constexpr SettingSpec<byte> minPercent("minPercent", DEFAULT_MIN_PERCENT, 0, 100);
+    inline constexpr SettingSpec<byte> minStartPercent("minStartPercent", MIN_START_PERCENT, 0, 100);
+
+    inline constexpr SettingSpec<int> pmwFrequency("pmwFrequency", PWM_FREQ, 1, 40000000);
+    inline constexpr SettingSpec<byte> pmwChannel("pmwChannel", PWM_CHANNEL, 0, 15);
+    inline constexpr SettingSpec<byte> pmwResolution("pmwResolution", PWM_RESOLUTION, 1, 20);
+
+    inline constexpr SettingSpec<bool> stateMessage("stateMessage", DEFAULT_FAN_STATE_MESSAGE);
+    inline constexpr SettingSpec<bool> legacyTopics("legacyTopics", DEFAULT_FAN_LEGACY_TOPICS);
+    inline constexpr SettingSpec<byte> stateDeadband("stateDeadband", DEFAULT_FAN_STATE_DEADBAND, 0, 100);
+    inline constexpr SettingSpec<int> stateHeartbeat("stateHeartbeat", DEFAULT_FAN_STATE_HEARTBEAT_SECS, 0, 86400);
+
+    inline constexpr SettingSpec<byte> rampRate("rampRate", DEFAULT_FAN_RAMP_RATE, 0, 100);
+    inline constexpr SettingSpec<int> rpmRampRate("rpmRampRate", DEFAULT_FAN_RPM_RAMP_RATE, 0, 30000);
+
+    inline constexpr SettingSpec<int> rpmKp("rpmKp", DEFAULT_FAN_RPM_KP, 0, 1000000);
+    inline constexpr SettingSpec<int> rpmKi("rpmKi", DEFAULT_FAN_RPM_KI, 0, 1000000);
+
+    // set by fan/calibrate, see fanCurve.h. Empty is uncalibrated.
+    inline constexpr SettingSpec<String> rpmCurve("rpmCurve", "", FAN_CURVE_TEXT_LENGTH);
+}
+
+enum FanControlMode {
+    FAN_CONTROL_PERCENT,        // setSpeed, open loop with the ramp
+    FAN_CONTROL_RPM,            // setRPM, closed loop on the tacho
+    FAN_CONTROL_CALIBRATE       // calibrate, the sweep sets the duty
+};
+
+enum FanCalibrationPhase {
+    FAN_CALIBRATION_SWEEP,      // down the curve's duty steps from 100%
+    FAN_CALIBRATION_KICK,       // stopped, back to 100% before looking for the stall
+    FAN_CALIBRATION_STALL,      // down 1% at a time until it stops
+    FAN_CALIBRATION_START       // up 1% at a time from standstill until it turns
+};
 
 class FanPWM : public ModuleBase
 {
@@ -20,6 +66,116 @@ class FanPWM : public ModuleBase
         byte targetSpeedPercent = 0;
         bool isRunning = false;
 
+        // settings, read through these rather than looked up by name
+        Setting<short> *startSpeedSetting;
+        Setting<byte> *fanPinSetting;
+        Setting<byte> *relayPinSetting;
+        Setting<int> *maxRPMSetting;
+        Setting<byte> *minPercentSetting;
+        Setting<byte> *minStartPercentSetting;
+        Setting<int> *pmwFrequencySetting;
+        Setting<byte> *pmwChannelSetting;
+        Setting<byte> *pmwResolutionSetting;
+        Setting<bool> *stateMessageSetting;
+        Setting<bool> *legacyTopicsSetting;
+        Setting<byte> *stateDeadbandSetting;
+        Setting<int> *stateHeartbeatSetting;
+        Setting<byte> *rampRateSetting;
+        Setting<int> *rpmRampRateSetting;
+        Setting<int> *rpmKpSetting;
+        Setting<int> *rpmKiSetting;
+        Setting<String> *rpmCurveSetting;
+
+        // the settings setSpeed() and the ramp use, kept up to date by
+        // their onChange() callbacks
+        byte fanPin = FanPWMSettings::fanPin.defaultValue;
+        byte relayPin = FanPWMSettings::relayPin.defaultValue;
+        byte minPercent = FanPWMSettings::minPercent.defaultValue;
+        byte minStartPercent = FanPWMSettings::minStartPercent.defaultValue;
+        int pwmFrequency = FanPWMSettings::pmwFrequency.defaultValue;
+        byte pwmChannel = FanPWMSettings::pmwChannel.defaultValue;
+        byte pwmResolution = FanPWMSettings::pmwResolution.defaultValue;
+
+        // the ramp to targetSpeedPercent, one hardware fade at a time. A
+        // duty written while one runs waits for it to end.
+        int rampJob = -1;
+        bool fading = false;
+        byte fadeTargetPercent = 0;
+        unsigned long fadeEndsMillis = 0;
+        bool dutyPending = false;
+        int32_t pendingDutyQ16 = 0;
+        bool pwmConfigPending = false;      // a PWM setting changed mid fade
+        byte attachedPin = 0;
+        bool pwmPinAttached = false;
+        uint32_t fades = 0;
+        uint32_t deferredWrites = 0;
+
+        // closed-loop speed control. A PI controller on the tacho's RPM
+        // adds to a feed-forward duty for the target, in fixed point:
+        // percents of duty with 16 fractional bits, so the duty is set
+        // to the LEDC's full resolution rather than whole percents.
+        FanControlMode controlMode = FAN_CONTROL_PERCENT;
+        int targetRPM = 0;
+        int setpointRPM = 0;            // moves to targetRPM at rpmRampRate
+        int32_t kpQ16 = 0;              // per rpm of error
+        int32_t kiQ16 = 0;              // per rpm of error per period
+        int32_t integralQ16 = 0;
+        int32_t outputQ16 = 0;
+
+        // how well it does, since the target last changed
+        unsigned long targetChangedMillis = 0;
+        bool settled = false;
+        byte periodsInBand = 0;
+        uint32_t settlingMillis = 0;
+        int64_t settledErrorSum = 0;
+        uint64_t settledErrorSquares = 0;
+        uint32_t settledPeriods = 0;
+
+        // and overall
+        uint32_t maxSettlingMillis = 0;
+        uint32_t settles = 0;
+        uint32_t controlPeriods = 0;
+        uint32_t saturatedPeriods = 0;
+
+        // the measured curve, the feed-forward when it is valid
+        FanCurve curve;
+
+        // the calibration sweep, a one-shot job that re-arms itself
+        // every FAN_CALIBRATION_SAMPLE_MILLIS until it is done
+        int calibrationJob = -1;
+        FanCalibrationPhase calibrationPhase = FAN_CALIBRATION_SWEEP;
+        int calibrationPoint = 0;
+        byte calibrationDuty = 0;
+        byte calibrationStall = 0;
+        uint16_t calibrationRPM[FAN_CURVE_POINTS] = {};
+        int runLowestRPM = 0;           // the readings settling at this step
+        int runHighestRPM = 0;
+        byte runReadings = 0;
+        uint32_t lastTachoUpdates = 0;
+        unsigned long stepStartedMillis = 0;
+        unsigned long calibrationStartedMillis = 0;
+
+        // what to go back to afterwards
+        FanControlMode modeBeforeCalibration = FAN_CONTROL_PERCENT;
+        bool runningBeforeCalibration = false;
+        byte speedBeforeCalibration = 0;
+        int rpmBeforeCalibration = 0;
+
+        uint32_t calibrations = 0;
+        uint32_t calibrationFailures = 0;
+        uint32_t calibrationMillis = 0;     // the last one took
+
+#ifdef ENABLE_MQTT
+        // last state message sent, for change detection
+        byte reportedCurrentPercent = 0;
+        byte reportedTargetPercent = 0;
+        bool reportedRunning = false;
+        bool stateReported = false;
+        unsigned long stateReportedMillis = 0;
+
+        uint32_t statePublished = 0;
+        uint32_t stateSuppressed = 0;
+#endif
 
     public:
         FanPWM(SettingsManager& settingsManager);
@@ -29,16 +185,45 @@ class FanPWM : public ModuleBase
         void loop() override;
 
         void getInfoForLog(Logger &log) const override;
-        String getInfoForJson() const override;
+        JsonDocument getInfoForJson() const override;
 
         void setSpeed(int requestedSpeedPercent);
 
+        // holds the fan at rpm with the tacho, 0 stops it
+        void setRPM(int rpm);
+
+        // sweeps the duty and measures the speed at each step, the stall
+        // and the start duties. Sets rpmCurve, minPercent, minStartPercent
+        // and maxRPM from them and publishes the result to calibration.
+        // setSpeed() or setRPM() abandons it.
+        void calibrate();
+        void abortCalibration(const char *reason);
+
 #ifdef ENABLE_MQTT
         void reportToMQTT();
 #endif
 
     private:
-        void handleCommands(const String& command, const String& payload);
+#ifdef ENABLE_MQTT
+        void publishStateIfChanged();
+#endif
+        void subscribeToSettings();
+        void applyPWMConfig();
+        void chaseTargetSpeed();
+        void controlRPM();
+        int32_t feedForwardQ16(int rpm) const;
+        void writeDutyQ16(int32_t percentQ16);
+        void setDutyQ16(int32_t percentQ16);
+        bool fadeTo(byte percent, uint32_t fadeMillis);
+        void calibrationStep();
+        bool calibrationSettled(int reading);
+        bool calibrationTimedOut() const;
+        void setCalibrationDuty(byte percent);
+        void finishCalibration(byte stall, byte start);
+        void endCalibration();
+        void restoreAfterCalibration();
+        void loadCurve(const String &text);
+        void handleCommands(std::string_view command, std::string_view payload);
         int getPWMValue(int speedPercent) const;
 };  
 #endif
\ No newline at end of file
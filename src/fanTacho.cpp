@@ -0,0 +1,321 @@
+#include "fanController.h"
+#include "fanTacho.h"
+#include <esp_timer.h>
+#include <algorithm>
+
+// the counter goes back to 0 when it gets here, reads are far closer
+// together than this many pulses
+#define TACHO_COUNTER_LIMIT 32767
+
+// the capture timer runs from the APB clock
+#define TACHO_CAPTURE_TICKS_PER_SECOND 80000000
+
+static_assert(settingsSchemaValid(FanTachoSettings::tachoPin, FanTachoSettings::pulsesPerRev,
+                                  FanTachoSettings::periodMode),
+              "FanTacho settings: a default is out of range or two names have the same id");
+
+
+FanTacho::FanTacho(SettingsManager &settingsManager)
+    : ModuleBase(FAN_TACHO_MODULE_NAME, FAN_TACHO_MODULE_VERSION, settingsManager)
+{
+    tachoPinSetting = settings.addSetting(FanTachoSettings::tachoPin);
+    pulsesPerRevSetting = settings.addSetting(FanTachoSettings::pulsesPerRev);
+    periodModeSetting = settings.addSetting(FanTachoSettings::periodMode);
+}
+
+FanTacho::~FanTacho()
+{
+}
+
+void FanTacho::setup()
+{
+    configureCounter();
+    if (periodModeSetting->get())
+    {
+        startCapture();
+    }
+
+    // a new pin is counted, and timed, from the next read on
+    tachoPinSetting->onChange([this](const byte &) {
+        configureCounter();
+        if (capturing)
+        {
+            stopCapture();
+            startCapture();
+        }
+    });
+
+    periodModeSetting->onChange([this](const bool &on) {
+        pulsesTooFast = false;
+        if (on)
+        {
+            startCapture();
+        }
+        else
+        {
+            stopCapture();
+        }
+    });
+
+    scheduler.addPeriodic("tacho.read", TACHO_UPDATE_CYCLE, TACHO_UPDATE_CYCLE / 10,
+                          std::bind(&FanTacho::readRPM, this));
+    scheduler.addPeriodic("tacho.period", TACHO_PERIOD_CHECK_MILLIS, TACHO_PERIOD_CHECK_MILLIS,
+                          std::bind(&FanTacho::checkPeriods, this));
+}
+
+void FanTacho::loop()
+{
+    // nothing to poll, the counter runs by itself and is read by a scheduled job
+}
+
+// counts the falling edges on the tacho pin, up to TACHO_COUNTER_LIMIT
+void FanTacho::configureCounter()
+{
+    pcnt_config_t config = {};
+    config.pulse_gpio_num = tachoPinSetting->get();
+    config.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+    config.lctrl_mode = PCNT_MODE_KEEP;
+    config.hctrl_mode = PCNT_MODE_KEEP;
+    config.pos_mode = PCNT_COUNT_DIS;
+    config.neg_mode = PCNT_COUNT_INC;
+    config.counter_h_lim = TACHO_COUNTER_LIMIT;
+    config.counter_l_lim = 0;
+    config.unit = TACHO_PCNT_UNIT;
+    config.channel = PCNT_CHANNEL_0;
+
+    counterReady = pcnt_unit_config(&config) == ESP_OK &&
+                   pcnt_set_filter_value(TACHO_PCNT_UNIT, TACHO_FILTER_APB_CYCLES) == ESP_OK &&
+                   pcnt_filter_enable(TACHO_PCNT_UNIT) == ESP_OK &&
+                   pcnt_counter_clear(TACHO_PCNT_UNIT) == ESP_OK &&
+                   pcnt_counter_resume(TACHO_PCNT_UNIT) == ESP_OK;
+    if (!counterReady)
+    {
+        Log.printfln("ERROR! FANTACHO: can't count pulses on pin %u", tachoPinSetting->get());
+        return;
+    }
+
+    lastCount = 0;
+    lastReadMicros = esp_timer_get_time();
+    countedRPM = 0;
+    Log.printfln("FANTACHO: counting on pin %u, unit %u", tachoPinSetting->get(), TACHO_PCNT_UNIT);
+}
+
+void FanTacho::readRPM()
+{
+    int16_t count;
+    if (!counterReady || pcnt_get_counter_value(TACHO_PCNT_UNIT, &count) != ESP_OK)
+    {
+        counterErrors++;
+        return;
+    }
+    int64_t now = esp_timer_get_time();
+
+    // the counter keeps running, so take the pulses since the last read
+    uint32_t pulses = (count - lastCount + TACHO_COUNTER_LIMIT) % TACHO_COUNTER_LIMIT;
+    int64_t elapsedMicros = now - lastReadMicros;
+    lastCount = count;
+    lastReadMicros = now;
+
+    if (elapsedMicros <= 0)
+    {
+        return;
+    }
+    countedRPM = (pulses * 60000000LL + elapsedMicros * pulsesPerRevSetting->get() / 2) /
+                 (elapsedMicros * pulsesPerRevSetting->get());
+    totalPulses += pulses;
+    readings++;
+
+    if (!capturing)
+    {
+        rpm = countedRPM;
+        rpmUpdates++;
+
+        // slow enough to time the pulses again
+        uint32_t pulseHz = pulses * 1000000LL / elapsedMicros;
+        if (pulsesTooFast && pulseHz < TACHO_PERIOD_MAX_PULSE_HZ * 8 / 10)
+        {
+            pulsesTooFast = false;
+            startCapture();
+        }
+    }
+
+#ifdef ENABLE_MQTT
+    MQTT.publishInt("rpm", rpm);
+#endif
+}
+
+// timestamps every falling edge on the tacho pin
+void FanTacho::startCapture()
+{
+    portENTER_CRITICAL(&captureLock);
+    capturedEdges = 0;
+    portEXIT_CRITICAL(&captureLock);
+    updatedAtEdge = 0;
+    lastSeenEdges = 0;
+    lastEdgeMillis = millis();
+
+    mcpwm_capture_config_t config = {};
+    config.cap_edge = MCPWM_NEG_EDGE;
+    config.cap_prescale = 1;
+    config.capture_cb = onCapture;
+    config.user_data = this;
+
+    capturing = mcpwm_gpio_init(TACHO_MCPWM_UNIT, MCPWM_CAP_0, tachoPinSetting->get()) == ESP_OK &&
+                mcpwm_capture_enable_channel(TACHO_MCPWM_UNIT, MCPWM_SELECT_CAP0, &config) == ESP_OK;
+    if (!capturing)
+    {
+        Log.printfln("ERROR! FANTACHO: can't time pulses on pin %u, counting them", tachoPinSetting->get());
+    }
+}
+
+void FanTacho::stopCapture()
+{
+    if (capturing)
+    {
+        mcpwm_capture_disable_channel(TACHO_MCPWM_UNIT, MCPWM_SELECT_CAP0);
+        capturing = false;
+    }
+    rpm = countedRPM;
+}
+
+// the capture interrupt, keeps the period since the previous edge
+bool IRAM_ATTR FanTacho::onCapture(mcpwm_unit_t, mcpwm_capture_channel_id_t,
+                                   const cap_event_data_t *event, void *tacho)
+{
+    FanTacho *self = static_cast<FanTacho *>(tacho);
+
+    portENTER_CRITICAL_ISR(&self->captureLock);
+    if (self->capturedEdges > 0)
+    {
+        self->periods[self->capturedEdges % TACHO_PERIOD_SAMPLES] = event->cap_value - self->lastCaptureTicks;
+    }
+    self->lastCaptureTicks = event->cap_value;
+    self->capturedEdges++;
+    portEXIT_CRITICAL_ISR(&self->captureLock);
+
+    return false;   // no task to wake
+}
+
+// once a revolution has gone by, takes the speed from the median of
+// the latest periods
+void FanTacho::checkPeriods()
+{
+    if (!capturing)
+    {
+        return;
+    }
+
+    uint32_t ring[TACHO_PERIOD_SAMPLES];
+    portENTER_CRITICAL(&captureLock);
+    uint32_t edges = capturedEdges;
+    memcpy(ring, periods, sizeof(ring));
+    portEXIT_CRITICAL(&captureLock);
+
+    unsigned long now = millis();
+    if (edges != lastSeenEdges)
+    {
+        lastSeenEdges = edges;
+        lastEdgeMillis = now;
+    }
+    else if (now - lastEdgeMillis >= TACHO_STOPPED_MILLIS)
+    {
+        // stopped, start again so the first period doesn't span the stop
+        if (edges > 0)
+        {
+            portENTER_CRITICAL(&captureLock);
+            capturedEdges = 0;
+            portEXIT_CRITICAL(&captureLock);
+            lastSeenEdges = 0;
+            updatedAtEdge = 0;
+        }
+        medianPeriodTicks = 0;
+        periodRPM = 0;
+        rpm = 0;
+        rpmUpdates++;
+        return;
+    }
+
+    byte pulsesPerRev = pulsesPerRevSetting->get();
+    uint32_t periodCount = edges > 0 ? edges - 1 : 0;
+    if (periodCount < pulsesPerRev || edges - updatedAtEdge < pulsesPerRev)
+    {
+        return;
+    }
+
+    // the newest periods, the ring holds period n at n % TACHO_PERIOD_SAMPLES
+    uint32_t latest[TACHO_PERIOD_SAMPLES];
+    size_t count = std::min<uint32_t>(periodCount, TACHO_PERIOD_SAMPLES);
+    for (size_t i = 0; i < count; i++)
+    {
+        latest[i] = ring[(edges - 1 - i) % TACHO_PERIOD_SAMPLES];
+    }
+
+    size_t middle = count / 2;
+    std::nth_element(latest, latest + middle, latest + count);
+    uint32_t median = latest[middle];
+    if (count % 2 == 0)
+    {
+        median = (median + *std::max_element(latest, latest + middle)) / 2;
+    }
+
+    updatedAtEdge = edges;
+    medianPeriodTicks = median;
+    periodUpdates++;
+
+    if (median < TACHO_CAPTURE_TICKS_PER_SECOND / TACHO_PERIOD_MAX_PULSE_HZ)
+    {
+        fallbacks++;
+        pulsesTooFast = true;
+        stopCapture();
+        Log.printfln("FANTACHO: pulses faster than %u Hz, counting them", TACHO_PERIOD_MAX_PULSE_HZ);
+        return;
+    }
+
+    periodRPM = (60ULL * TACHO_CAPTURE_TICKS_PER_SECOND + (uint64_t)median * pulsesPerRev / 2) /
+                ((uint64_t)median * pulsesPerRev);
+    rpm = periodRPM;
+    rpmUpdates++;
+}
+
+void FanTacho::getInfoForLog(Logger &log) const
+{
+    ModuleBase::getInfoForLog(log);
+
+    log.printfln("Tacho Pin: %u", tachoPinSetting->get());
+    log.printfln("Pulses per Revolution: %u", pulsesPerRevSetting->get());
+    log.printfln("RPM: %d (%s), counted %d, timed %d", rpm, capturing ? "timed" : "counted", countedRPM, periodRPM);
+    log.printfln("Counter: unit %u, filter %u cycles, %s", TACHO_PCNT_UNIT, TACHO_FILTER_APB_CYCLES,
+                 counterReady ? "running" : "NOT RUNNING");
+    log.printfln("Pulses: %llu in %u readings, %u errors", totalPulses, readings, counterErrors);
+    log.printfln("Period Mode: %s, median period %u us, %u updates, %u fallbacks to counting",
+                 periodModeSetting->get() ? "Yes" : "No", medianPeriodTicks / (TACHO_CAPTURE_TICKS_PER_SECOND / 1000000),
+                 periodUpdates, fallbacks);
+}
+
+JsonDocument FanTacho::getInfoForJson() const
+{
+    JsonDocument doc = startJsonDoc();
+
+    doc["tachoPin"] = tachoPinSetting->get();
+    doc["pulsesPerRev"] = pulsesPerRevSetting->get();
+    doc["rpm"] = rpm;
+    doc["source"] = capturing ? "period" : "count";
+
+    JsonObject counter = doc["counter"].to<JsonObject>();
+    counter["unit"] = (int)TACHO_PCNT_UNIT;
+    counter["filterCycles"] = TACHO_FILTER_APB_CYCLES;
+    counter["running"] = counterReady;
+    counter["pulses"] = totalPulses;
+    counter["readings"] = readings;
+    counter["errors"] = counterErrors;
+    counter["rpm"] = countedRPM;
+
+    JsonObject capture = doc["capture"].to<JsonObject>();
+    capture["enabled"] = periodModeSetting->get();
+    capture["rpm"] = periodRPM;
+    capture["medianPeriodUs"] = medianPeriodTicks / (TACHO_CAPTURE_TICKS_PER_SECOND / 1000000);
+    capture["updates"] = periodUpdates;
+    capture["fallbacks"] = fallbacks;
+
+    return doc;
+}
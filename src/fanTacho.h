@@ -0,0 +1,111 @@
+#pragma once
+#ifndef FAN_TACHO_H
+#define FAN_TACHO_H
+
+#define FAN_TACHO_MODULE_NAME "FanTacho"
+#define FAN_TACHO_MODULE_VERSION "1.0"
+
+#include <Arduino.h>
+#include <driver/pcnt.h>
+#include <driver/mcpwm.h>
+#include <freertos/FreeRTOS.h>
+
+#include "config.h"
+#include "settings.h"
+#include "modules/moduleBase.h"
+
+// the FanTacho settings, see settings/settingSpec.h
+namespace FanTachoSettings
+{
+    inline constexpr SettingSpec<byte> tachoPin("tachoPin", DEFAULT_TACH_PIN, 0, 39);
+    inline constexpr SettingSpec<byte> pulsesPerRev("pulsesPerRev", NUMB_INTERRUPS_PER_ROTATION, 1, 8);
+    inline constexpr SettingSpec<bool> periodMode("periodMode", DEFAULT_TACHO_PERIOD_MODE);
+}
+
+// Measures the fan's speed from its tacho output with the ESP32 pulse
+// counter. The hardware counts the falling edges, after its glitch
+// filter, so a pulse costs no CPU time. Every TACHO_UPDATE_CYCLE the
+// counter is read without pausing or clearing it and the speed worked
+// out from the pulses since the last read, so no edge is lost while
+// reading.
+//
+// Counting over a second only resolves 60 / pulsesPerRev RPM and lags
+// by up to a second. In period mode the MCPWM capture timer also
+// timestamps each falling edge, and the speed is worked out from the
+// moving median of the last TACHO_PERIOD_SAMPLES pulse periods every
+// revolution. The median ignores the odd glitch and the unequal
+// periods of the fan's magnet poles. Each edge is an interrupt, so
+// above TACHO_PERIOD_MAX_PULSE_HZ the capture is stopped and the count
+// used until the fan slows down again.
+class FanTacho : public ModuleBase
+{
+    private:
+        Setting<byte> *tachoPinSetting;
+        Setting<byte> *pulsesPerRevSetting;
+        Setting<bool> *periodModeSetting;
+
+        bool counterReady = false;
+        int16_t lastCount = 0;
+        int64_t lastReadMicros = 0;
+        int countedRPM = 0;
+
+        // written by the capture interrupt, under captureLock
+        portMUX_TYPE captureLock = portMUX_INITIALIZER_UNLOCKED;
+        uint32_t periods[TACHO_PERIOD_SAMPLES];     // capture timer ticks, a ring
+        uint32_t lastCaptureTicks = 0;
+        uint32_t capturedEdges = 0;                 // since the capture was (re)started
+
+        bool capturing = false;
+        uint32_t updatedAtEdge = 0;
+        uint32_t lastSeenEdges = 0;
+        unsigned long lastEdgeMillis = 0;
+        uint32_t medianPeriodTicks = 0;
+        int periodRPM = 0;
+
+        int rpm = 0;
+        uint32_t rpmUpdates = 0;
+
+        // statistics
+        uint64_t totalPulses = 0;
+        uint32_t readings = 0;
+        uint32_t counterErrors = 0;
+        uint32_t periodUpdates = 0;
+        uint32_t fallbacks = 0;                     // times the pulses got too fast to time
+        bool pulsesTooFast = false;
+
+    public:
+        FanTacho(SettingsManager& settingsManager);
+
+        ~FanTacho();
+
+        void setup() override;
+        void loop() override;
+
+        // revolutions per minute, from the pulse periods of about the
+        // last revolution in period mode, otherwise over the last
+        // TACHO_UPDATE_CYCLE
+        int getRPM() const { return rpm; }
+
+        // goes up each time the speed is measured, to tell a new reading
+        // from the last one read again, e.g. while a fan coasts to a stop
+        uint32_t getUpdates() const { return rpmUpdates; }
+
+        // true while the speed comes from the pulse periods
+        bool isTimingPulses() const { return capturing; }
+
+        void getInfoForLog(Logger &log) const override;
+        JsonDocument getInfoForJson() const override;
+
+    private:
+        void configureCounter();
+        void readRPM();
+
+        void startCapture();
+        void stopCapture();
+        void checkPeriods();
+        static bool onCapture(mcpwm_unit_t unit, mcpwm_capture_channel_id_t channel,
+                              const cap_event_data_t *event, void *tacho);
+
+};  // class FanTacho
+
+#endif // FAN_TACHO_H
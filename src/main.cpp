@@ -1,6 +1,7 @@
 #define DEFINE_GLOBAL_VARS
 
 #include "fanController.h"
+#include "simBenchmarks.h"
 #include <vector> // or the appropriate container header
 #include "esp_wifi.h"
 #include "esp_sleep.h"
@@ -9,6 +10,14 @@
 void enterSleepMode();
 #endif
 
+// loop statistics, reported and reset by the stats job
+static unsigned int loopCount = 0;
+static unsigned long totalLoopTimeMillis = 0;
+static unsigned long maxLoopMillis = 0;
+
+void checkDirtySettings();
+void dumpStats();
+
 void setup()
 {
 
@@ -21,29 +30,39 @@ void setup()
 
     settingsManager.loadAll();
 
+    LatencyHistogram::begin();
+    Log.printfln("Profiler overhead: %u ns per sample", LatencyHistogram::getOverheadNanos());
+
     // initialise all of the modules
     for (const auto &module : modules)
     {
-        // monitor the time the module takes to setup and log an message if more than WATCHDOG_MAX_SETUP_MILLIS
-        unsigned long setupStart = millis();
+        // profile the time the module takes to setup and log an message if more than WATCHDOG_MAX_SETUP_MILLIS
+        uint32_t setupStart = LatencyHistogram::startTimer();
         module->setup();
-        unsigned long setupTime = millis() - setupStart;
-        if (setupTime > WATCHDOG_MAX_SETUP_MILLIS)
+        uint32_t setupMicros = module->getSetupProfile().recordSince(setupStart);
+        if (setupMicros > WATCHDOG_MAX_SETUP_MILLIS * 1000)
         {
-            Log.printfln("Module %s took %u ms to setup", module->getMeta().name, setupTime);
+            Log.printfln("Module %s took %u ms to setup", module->getMeta().name, setupMicros / 1000);
         }
     }
 
+    // every 500ms, check if settings are dirty and save if they are
+    scheduler.addPeriodic("settings.save", 500, 500, checkDirtySettings);
+
+    // every STATS_INTERVAL milliseconds, dump the stats/diagnostics
+    // currently 60 seconds, first dump half way through
+    scheduler.addPeriodic("stats", STATS_INTERVAL, 1000, dumpStats, STATS_INTERVAL / 2);
+
+#if defined(FAN_NATIVE_SIM) && defined(ENABLE_MQTT)
+    registerSimBenchmarks();
+#endif
+
     Network.start();
 }
 
 
 // Never use blocking code in loop() to avoid problems with other tasks
 void loop() {
-    static unsigned int loopCount = 0;
-    static unsigned long totalLoopTimeMillis = 0;
-    static unsigned long maxLoopMillis = 0;
-
     unsigned long now = millis();
     unsigned long thisloopTimeMillis = 0;
 
@@ -51,79 +70,20 @@ void loop() {
     {
         //Log.printfln("Module %s loop", module->getMeta().name);
 
-        // monitor the time the module takes to loop and log an message if more than WATCHDOG_MAX_LOOP_MILLIS
-        unsigned long loopStart = millis();
+        // profile the time the module takes to loop and log an message if more than WATCHDOG_MAX_LOOP_MILLIS
+        uint32_t loopStart = LatencyHistogram::startTimer();
         module->loop();
-        unsigned long loopTime = millis() - loopStart;
-        if (loopTime > WATCHDOG_MAX_LOOP_MILLIS)
+        uint32_t loopMicros = module->getLoopProfile().recordSince(loopStart);
+        if (loopMicros > WATCHDOG_MAX_LOOP_MILLIS * 1000)
         {
-            Log.printfln("Module %s took %u ms to loop", module->getMeta().name, loopTime);
+            Log.printfln("Module %s took %u ms to loop", module->getMeta().name, loopMicros / 1000);
         }
 
         yield;
     }
 
-
-    // every 500ms, check if settings are dirty and save if they are
-    static unsigned long settingsCheckMillis = 0;
-    if (now - settingsCheckMillis > 500)
-    {
-        if (settingsManager.isDirty()) {
-            Log.println("** Settings are dirty, saving");
-            settingsManager.saveAll();
-        }
-        settingsCheckMillis = millis();
-        yield();
-    }
-
-    // every STATS_INTERVAL milliseconds, dump the stats/diagnostics
-    // currently 60 seconds
-    static unsigned long lastDebugStats = millis() - (STATS_INTERVAL / 2);
-    if (now - lastDebugStats > STATS_INTERVAL)
-    {
-        lastDebugStats = millis();
-
-        Log.println("|> DEBUG STATS ---------------------------------------------------");
-        Log.dumpStats();
-
-        for (const auto &module : modules) {
-            module->getInfoForLog(Log);
-            yield();
-
-            if (MQTT.getStatus() == MQTT_CONNECTED)
-            {
-                String json = module->getInfoForJson();
-                String topic = "diagnostics/" + String(module->getMeta().name);
-                MQTT.publish(topic, json);
-                yield();
-            }
-        }
-
-
-
-        // avoid division by zero
-        if (loopCount == 0)
-            loopCount = 1;
-
-        int statsSeconds = STATS_INTERVAL / 1000;
-        unsigned int loopsPerSecond = loopCount / statsSeconds;
-        
-        Log.println("|> Loop Information");
-        Log.printfln("|>  - Loop Count : %d", loopCount);
-        Log.printfln("|>  - Loop/second: %u", loopsPerSecond);
-        Log.printfln("|>  - Total Loop Time: %u ms", totalLoopTimeMillis);
-        Log.printfln("|>  - Average Loop Time: %.2f ms", static_cast<float>(totalLoopTimeMillis) / loopCount);
-        Log.printfln("|>  - Maximum Loop Time: %u ms", maxLoopMillis);
-
-        loopCount = 0;
-        maxLoopMillis = 0;
-        totalLoopTimeMillis = 0;
-
-        Log.println("|> ---------------------------------------------------------------");
-        yield();
-    }
-
-
+    // periodic work (fan ramp, settings save, stats, ...) that is due
+    scheduler.run();
 
 
     // Loop housekeeping and monitoring
@@ -149,23 +109,17 @@ void loop() {
     yield();
 
 
-    // Restart if requested but if settings are dirty
-    // do the restart on the next loop to allow time for them
-    // to be saved.
+    // Restart if requested, writing any changed settings first
     if (restartRequested) {
-        if (settingsManager.isDirty()) {
-            Log.println("Restart requested but settings need saving.");
-        }
-        else {
+        settingsManager.flush();
 
-            #ifdef ENABLE_MQTT
-            MQTT.publish("STATUS", "offline", true);
-            MQTT.disconnect();
-            #endif
+        #ifdef ENABLE_MQTT
+        MQTT.publish("STATUS", "offline", true);
+        MQTT.disconnect();
+        #endif
 
-            Log.println("Rebooting...");
-            ESP.restart();
-        }
+        Log.println("Rebooting...");
+        ESP.restart();
         yield();
     }
 
@@ -197,7 +151,91 @@ void loop() {
     }
 #endif
 
-    yield();
+    // nothing to do until the next job is due, so give the CPU away
+    // rather than spinning. Capped so the modules' loop() still polls
+    // their sockets regularly.
+    uint32_t idleMillis = scheduler.millisUntilNextJob(SCHEDULER_MAX_IDLE_MILLIS);
+    if (idleMillis > 0)
+    {
+        delay(idleMillis);
+    }
+    else
+    {
+        yield();
+    }
+}
+
+void checkDirtySettings()
+{
+    // only stages the changes, the persister task writes them
+    settingsManager.saveAll();
+}
+
+void dumpStats()
+{
+    Log.println("|> DEBUG STATS ---------------------------------------------------");
+    Log.dumpStats();
+
+    // most heap used at once by one module's diagnostics (native build only)
+    size_t diagnosticsPeakHeap = 0;
+    ModuleBase *diagnosticsPeakModule = nullptr;
+
+    for (const auto &module : modules) {
+        module->getInfoForLog(Log);
+        yield();
+
+        size_t heapBefore = getHeapInUse();
+        resetPeakHeap();
+
+        // serialized straight into the packet, or queued while disconnected
+        char topic[MQTT_MAX_TOPIC_LENGTH];
+        snprintf(topic, sizeof(topic), "diagnostics/%s", module->getMeta().name);
+        MQTT.publishJson(topic, module->getInfoForJson());
+
+        if (getPeakHeap() - heapBefore > diagnosticsPeakHeap)
+        {
+            diagnosticsPeakHeap = getPeakHeap() - heapBefore;
+            diagnosticsPeakModule = module;
+        }
+        yield();
+
+        // loop latencies are per stats interval, setup is kept for good
+        module->getLoopProfile().reset();
+    }
+
+    scheduler.getInfoForLog(Log);
+    MQTT.publishJson("diagnostics/scheduler", scheduler.getInfoForJson());
+    scheduler.resetStats();
+
+    settingsManager.getInfoForLog(Log);
+    MQTT.publishJson("diagnostics/settings", settingsManager.getInfoForJson());
+
+#ifdef ALLOCATION_COUNTER_AVAILABLE
+    if (diagnosticsPeakModule)
+    {
+        Log.printfln("|> Diagnostics peak heap: %u bytes (%s)", diagnosticsPeakHeap, diagnosticsPeakModule->getMeta().name);
+    }
+#endif
+
+    // avoid division by zero
+    if (loopCount == 0)
+        loopCount = 1;
+
+    int statsSeconds = STATS_INTERVAL / 1000;
+    unsigned int loopsPerSecond = loopCount / statsSeconds;
+
+    Log.println("|> Loop Information");
+    Log.printfln("|>  - Loop Count : %d", loopCount);
+    Log.printfln("|>  - Loop/second: %u", loopsPerSecond);
+    Log.printfln("|>  - Total Loop Time: %u ms", totalLoopTimeMillis);
+    Log.printfln("|>  - Average Loop Time: %.2f ms", static_cast<float>(totalLoopTimeMillis) / loopCount);
+    Log.printfln("|>  - Maximum Loop Time: %u ms", maxLoopMillis);
+
+    loopCount = 0;
+    maxLoopMillis = 0;
+    totalLoopTimeMillis = 0;
+
+    Log.println("|> ---------------------------------------------------------------");
 }
 
 #ifdef ENABLE_SLEEP_MODE    
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Arduino.h>
+
+// ----------------------------------------------------------------
+// Heap allocation counter
+//
+// Only the native simulation can count allocations (it replaces
+// malloc), so on the device getAllocationCount() is always 0 and
+// ALLOCATION_COUNTER_AVAILABLE is not defined. Take the difference
+// of two readings to see what a piece of code allocates.
+//
+// The same goes for the peak heap: resetPeakHeap() then, after the
+// code has run, getPeakHeap() minus the heap in use at the reset is
+// the most it had allocated at once.
+// ----------------------------------------------------------------
+
+#ifdef FAN_NATIVE_SIM
+    #include <simAlloc.h>
+    #define ALLOCATION_COUNTER_AVAILABLE
+
+    inline uint32_t getAllocationCount()
+    {
+        return static_cast<uint32_t>(sim::allocationCount());
+    }
+
+    inline size_t getHeapInUse()
+    {
+        return sim::heapInUse();
+    }
+
+    inline size_t getPeakHeap()
+    {
+        return sim::peakHeapInUse();
+    }
+
+    inline void resetPeakHeap()
+    {
+        sim::resetPeakHeap();
+    }
+#else
+    inline uint32_t getAllocationCount()
+    {
+        return 0;
+    }
+
+    inline size_t getHeapInUse()
+    {
+        return 0;
+    }
+
+    inline size_t getPeakHeap()
+    {
+        return 0;
+    }
+
+    inline void resetPeakHeap()
+    {
+    }
+#endif
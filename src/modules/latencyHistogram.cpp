@@ -0,0 +1,87 @@
+#include "latencyHistogram.h"
+
+#define OVERHEAD_CALIBRATION_SAMPLES 1000
+
+uint32_t LatencyHistogram::cyclesPerMicro = 240;
+uint32_t LatencyHistogram::overheadNanos = 0;
+
+void LatencyHistogram::begin()
+{
+    cyclesPerMicro = ESP.getCpuFreqMHz();
+    if (cyclesPerMicro == 0)
+    {
+        cyclesPerMicro = 1;
+    }
+
+    // time a batch of back to back samples, each one reading the
+    // counter and recording, exactly as a caller would
+    LatencyHistogram scratch;
+    uint32_t start = ESP.getCycleCount();
+    for (int i = 0; i < OVERHEAD_CALIBRATION_SAMPLES; i++)
+    {
+        scratch.recordSince(startTimer());
+    }
+    uint32_t cycles = ESP.getCycleCount() - start;
+
+    overheadNanos = (uint64_t)cycles * 1000 / cyclesPerMicro / OVERHEAD_CALIBRATION_SAMPLES;
+}
+
+uint32_t LatencyHistogram::bucketUpperBound(int bucket)
+{
+    if (bucket < EXACT_BUCKETS)
+    {
+        return bucket;
+    }
+
+    int octave = (bucket - EXACT_BUCKETS) / BUCKETS_PER_OCTAVE + 3;
+    int sub = (bucket - EXACT_BUCKETS) % BUCKETS_PER_OCTAVE;
+    uint32_t width = 1UL << (octave - 2);
+    return (BUCKETS_PER_OCTAVE + sub) * width + width - 1;
+}
+
+uint32_t LatencyHistogram::getPercentile(uint8_t percentile) const
+{
+    if (samples == 0)
+    {
+        return 0;
+    }
+
+    // rank of the sample we want, rounded up so p100 is the last one
+    uint32_t rank = ((uint64_t)samples * percentile + 99) / 100;
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+
+    uint32_t seen = 0;
+    for (int i = 0; i < BUCKETS; i++)
+    {
+        seen += counts[i];
+        if (seen >= rank)
+        {
+            return min(bucketUpperBound(i), maxMicros);
+        }
+    }
+    return maxMicros;
+}
+
+void LatencyHistogram::reset()
+{
+    memset(counts, 0, sizeof(counts));
+    samples = 0;
+    maxMicros = 0;
+}
+
+void LatencyHistogram::addToJson(JsonObject json) const
+{
+    json["count"] = samples;
+    json["p50"] = getPercentile(50);
+    json["p99"] = getPercentile(99);
+    json["max"] = maxMicros;
+}
+
+void LatencyHistogram::printTo(Logger &log, const char *label) const
+{
+    log.printfln("|>  - %-6s %6u samples, p50 %6u us, p99 %7u us, max %7u us",
+                 label, samples, getPercentile(50), getPercentile(99), maxMicros);
+}
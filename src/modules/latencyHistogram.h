@@ -0,0 +1,99 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "../logger.h"
+
+// ----------------------------------------------------------------
+// Latency histogram
+//
+// Records durations in microseconds into log spaced buckets: exact
+// below 8 us, then 4 buckets per power of two (so any percentile is
+// within 25% of the true value). Recording is a count leading zeros,
+// a shift and an increment, no floating point and no allocation.
+//
+// Timing uses the CPU cycle counter (CCOUNT), which is cheaper to read
+// than esp_timer_get_time(). It wraps every ~17 s at 240 MHz, so it is
+// only suitable for measuring things shorter than that.
+// ----------------------------------------------------------------
+
+class LatencyHistogram
+{
+public:
+    // exact buckets for 0..7 us, then 4 per octave up to 2^27 us (~134 s)
+    static const int EXACT_BUCKETS = 8;
+    static const int BUCKETS_PER_OCTAVE = 4;
+    static const int MAX_OCTAVE = 26;
+    static const int BUCKETS = EXACT_BUCKETS + (MAX_OCTAVE - 2) * BUCKETS_PER_OCTAVE;
+
+private:
+    uint32_t counts[BUCKETS] = {};
+    uint32_t samples = 0;
+    uint32_t maxMicros = 0;
+
+    static uint32_t cyclesPerMicro;
+    static uint32_t overheadNanos;
+
+public:
+    // read the cycle counter at the start of the section being timed
+    static inline uint32_t startTimer()
+    {
+        return ESP.getCycleCount();
+    }
+
+    // record the time since startTimer(), returns it in microseconds
+    inline uint32_t recordSince(uint32_t startCycles)
+    {
+        uint32_t micros = (ESP.getCycleCount() - startCycles) / cyclesPerMicro;
+        record(micros);
+        return micros;
+    }
+
+    inline void record(uint32_t micros)
+    {
+        counts[bucketFor(micros)]++;
+        samples++;
+        if (micros > maxMicros)
+        {
+            maxMicros = micros;
+        }
+    }
+
+    // reads the CPU frequency and measures the cost of one sample,
+    // call once at startup (and again if the CPU frequency changes)
+    static void begin();
+    static uint32_t getOverheadNanos() { return overheadNanos; }
+
+    uint32_t getCount() const { return samples; }
+    uint32_t getMax() const { return maxMicros; }
+
+    // upper bound of the bucket holding the given percentile (0..100),
+    // never more than the maximum recorded
+    uint32_t getPercentile(uint8_t percentile) const;
+
+    void reset();
+
+    // count, p50, p99 and max (all in microseconds)
+    void addToJson(JsonObject json) const;
+    void printTo(Logger &log, const char *label) const;
+
+private:
+    static inline int bucketFor(uint32_t micros)
+    {
+        if (micros < EXACT_BUCKETS)
+        {
+            return micros;
+        }
+
+        int octave = 31 - __builtin_clz(micros);    // position of the top bit, >= 3
+        if (octave > MAX_OCTAVE)
+        {
+            return BUCKETS - 1;
+        }
+
+        int sub = (micros >> (octave - 2)) & (BUCKETS_PER_OCTAVE - 1);
+        return EXACT_BUCKETS + (octave - 3) * BUCKETS_PER_OCTAVE + sub;
+    }
+
+    static uint32_t bucketUpperBound(int bucket);
+};
@@ -4,6 +4,7 @@
 
 #include "moduleMeta.h"
 #include "moduleBase.h"
+#include "scheduler.h"
 
 
 
@@ -2,6 +2,7 @@
 
 #include "fanController.h"
 #include "moduleMeta.h"
+#include "latencyHistogram.h"
 #include <ArduinoJson.h>
 
 
@@ -11,6 +12,10 @@ protected:
     const ModuleMeta meta;
     SettingsCategory &settings;
 
+    // time spent in setup() and loop(), recorded by the main loop
+    LatencyHistogram setupProfile;
+    LatencyHistogram loopProfile;
+
 public:
     ModuleBase(const char *name, const char *version, SettingsManager &settingsManager)
         : meta(ModuleMeta(name, version)),
@@ -23,21 +28,32 @@ public:
 
     virtual void getInfoForLog(Logger &log) const {
         log.printfln("|> %s Module, version %s", meta.name, meta.version);
+        setupProfile.printTo(log, "setup");
+        loopProfile.printTo(log, "loop");
     };
 
-    virtual String getInfoForJson() const = 0;
+    // built fresh on each call, serialize it (or MQTT.publishJson() it)
+    // without keeping a String copy
+    virtual JsonDocument getInfoForJson() const = 0;
 
     virtual ModuleMeta getMeta() const
     {
         return meta;
     };
 
+    LatencyHistogram &getSetupProfile() { return setupProfile; }
+    LatencyHistogram &getLoopProfile() { return loopProfile; }
+
 protected:
     JsonDocument startJsonDoc() const
     {
         JsonDocument doc;
         doc["name"] = meta.name;
         doc["version"] = meta.version;
+
+        JsonObject profile = doc["profile"].to<JsonObject>();
+        setupProfile.addToJson(profile["setup"].to<JsonObject>());
+        loopProfile.addToJson(profile["loop"].to<JsonObject>());
         return doc;
     };
 };
@@ -0,0 +1,215 @@
+#include "scheduler.h"
+#include <ArduinoJson.h>
+#include <esp_timer.h>
+
+
+int Scheduler::addPeriodic(const char *name, uint32_t periodMillis, uint32_t deadlineMillis, SchedulerCallback callback, uint32_t initialDelayMillis)
+{
+    if (periodMillis == 0)
+    {
+        Log.printfln("Scheduler: job %s needs a period, use addOneShot()", name);
+        return SCHEDULER_INVALID_JOB;
+    }
+    return addJob(name, initialDelayMillis, periodMillis, deadlineMillis, callback);
+}
+
+int Scheduler::addOneShot(const char *name, uint32_t delayMillis, uint32_t deadlineMillis, SchedulerCallback callback)
+{
+    return addJob(name, delayMillis, 0, deadlineMillis, callback);
+}
+
+int Scheduler::addJob(const char *name, uint32_t delayMillis, uint32_t periodMillis, uint32_t deadlineMillis, SchedulerCallback callback)
+{
+    for (int i = 0; i < SCHEDULER_MAX_JOBS; i++)
+    {
+        Job &job = jobs[i];
+        if (job.name != nullptr)
+        {
+            continue;
+        }
+
+        job = Job();
+        job.name = name;
+        job.callback = callback;
+        job.periodMillis = periodMillis;
+        job.deadlineMillis = deadlineMillis;
+        job.dueMicros = esp_timer_get_time() + delayMillis * 1000LL;
+        job.active = true;
+        return i;
+    }
+
+    Log.printfln("Scheduler: no free slot for job %s, increase SCHEDULER_MAX_JOBS", name);
+    return SCHEDULER_INVALID_JOB;
+}
+
+void Scheduler::trigger(int jobId, uint32_t delayMillis)
+{
+    if (jobId < 0 || jobId >= SCHEDULER_MAX_JOBS || jobs[jobId].name == nullptr)
+    {
+        return;
+    }
+    jobs[jobId].dueMicros = esp_timer_get_time() + delayMillis * 1000LL;
+    jobs[jobId].active = true;
+}
+
+void Scheduler::cancel(int jobId)
+{
+    if (jobId < 0 || jobId >= SCHEDULER_MAX_JOBS)
+    {
+        return;
+    }
+    jobs[jobId].active = false;
+}
+
+int Scheduler::run()
+{
+    int jobsRun = 0;
+    int64_t now = esp_timer_get_time();
+
+    for (Job &job : jobs)
+    {
+        if (job.active && now >= job.dueMicros)
+        {
+            runJob(job, now);
+            jobsRun++;
+
+            // a long job moves time on for the ones after it
+            now = esp_timer_get_time();
+        }
+    }
+    return jobsRun;
+}
+
+void Scheduler::runJob(Job &job, int64_t now)
+{
+    int64_t due = job.dueMicros;
+    uint32_t jitter = static_cast<uint32_t>(now - due);
+
+    // re-arm (or disarm) before running, so the callback can trigger() its own job
+    if (job.periodMillis == 0)
+    {
+        job.active = false;
+    }
+    else
+    {
+        int64_t period = job.periodMillis * 1000LL;
+        job.dueMicros = due + period;
+
+        // fell more than a period behind, skip the missed runs rather than
+        // running back to back to catch up
+        if (job.dueMicros <= now)
+        {
+            int64_t missed = (now - due) / period;
+            job.skipped += missed;
+            job.dueMicros = due + (missed + 1) * period;
+        }
+    }
+
+    uint32_t allocationsBefore = getAllocationCount();
+    job.callback();
+    job.allocations += getAllocationCount() - allocationsBefore;
+
+    int64_t finished = esp_timer_get_time();
+    uint32_t runTime = static_cast<uint32_t>(finished - now);
+
+    job.runs++;
+    job.totalJitterMicros += jitter;
+    if (jitter > job.maxJitterMicros)
+    {
+        job.maxJitterMicros = jitter;
+    }
+    if (runTime > job.maxRunMicros)
+    {
+        job.maxRunMicros = runTime;
+    }
+    if (finished > due + job.deadlineMillis * 1000LL)
+    {
+        job.overruns++;
+    }
+}
+
+uint32_t Scheduler::millisUntilNextJob(uint32_t maxMillis) const
+{
+    int64_t now = esp_timer_get_time();
+    int64_t next = now + maxMillis * 1000LL;
+
+    for (const Job &job : jobs)
+    {
+        if (job.active && job.dueMicros < next)
+        {
+            next = job.dueMicros;
+        }
+    }
+
+    if (next <= now)
+    {
+        return 0;
+    }
+    // round up, sleeping 0 ms for a job that is 0.9 ms away would spin
+    return static_cast<uint32_t>((next - now + 999) / 1000);
+}
+
+void Scheduler::resetStats()
+{
+    for (Job &job : jobs)
+    {
+        job.runs = 0;
+        job.overruns = 0;
+        job.skipped = 0;
+        job.maxJitterMicros = 0;
+        job.totalJitterMicros = 0;
+        job.maxRunMicros = 0;
+        job.allocations = 0;
+    }
+}
+
+void Scheduler::getInfoForLog(Logger &log) const
+{
+    log.println("|> Scheduler");
+    for (const Job &job : jobs)
+    {
+        if (job.name == nullptr)
+        {
+            continue;
+        }
+
+        uint32_t avgJitter = job.runs ? job.totalJitterMicros / job.runs : 0;
+        log.printfln("|>  - %-16s runs %5u, jitter avg %6u us max %7u us, run max %7u us, overruns %u, skipped %u%s",
+                     job.name, job.runs, avgJitter, job.maxJitterMicros, job.maxRunMicros,
+                     job.overruns, job.skipped, job.active ? "" : " (idle)");
+#ifdef ALLOCATION_COUNTER_AVAILABLE
+        log.printfln("|>    %-16s heap allocations %u", "", job.allocations);
+#endif
+    }
+}
+
+JsonDocument Scheduler::getInfoForJson() const
+{
+    JsonDocument doc;
+    doc["name"] = "Scheduler";
+
+    JsonArray jobsJson = doc["jobs"].to<JsonArray>();
+    for (const Job &job : jobs)
+    {
+        if (job.name == nullptr)
+        {
+            continue;
+        }
+
+        JsonObject jobJson = jobsJson.add<JsonObject>();
+        jobJson["name"] = job.name;
+        jobJson["period"] = job.periodMillis;
+        jobJson["deadline"] = job.deadlineMillis;
+        jobJson["runs"] = job.runs;
+        jobJson["jitterAvgUs"] = job.runs ? job.totalJitterMicros / job.runs : 0;
+        jobJson["jitterMaxUs"] = job.maxJitterMicros;
+        jobJson["runMaxUs"] = job.maxRunMicros;
+        jobJson["overruns"] = job.overruns;
+        jobJson["skipped"] = job.skipped;
+#ifdef ALLOCATION_COUNTER_AVAILABLE
+        jobJson["allocations"] = job.allocations;
+#endif
+    }
+
+    return doc;
+}
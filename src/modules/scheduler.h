@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <functional>
+#include "../config.h"
+#include "../logger.h"
+#include "allocationCounter.h"
+
+// ----------------------------------------------------------------
+// Cooperative scheduler
+//
+// Modules register periodic or one-shot jobs instead of polling
+// millis() on every pass of loop(). run() executes the jobs that are
+// due and the main loop then sleeps until the next one, so the CPU
+// is idle rather than spinning between jobs.
+//
+// Each job has a deadline: the time after its due time by which it
+// must have completed. Lateness (jitter) and deadline overruns are
+// recorded per job.
+// ----------------------------------------------------------------
+
+#define SCHEDULER_INVALID_JOB -1
+
+typedef std::function<void()> SchedulerCallback;
+
+class Scheduler
+{
+private:
+    struct Job
+    {
+        const char *name = nullptr;
+        SchedulerCallback callback;
+        bool active = false;
+        int64_t dueMicros = 0;
+        uint32_t periodMillis = 0;      // 0 for a one-shot job
+        uint32_t deadlineMillis = 0;
+
+        // stats, reset by resetStats()
+        uint32_t runs = 0;
+        uint32_t overruns = 0;
+        uint32_t skipped = 0;           // periods missed because the job ran late
+        uint32_t maxJitterMicros = 0;
+        uint64_t totalJitterMicros = 0;
+        uint32_t maxRunMicros = 0;
+        uint32_t allocations = 0;       // heap allocations made by the job (native build only)
+    };
+
+    Job jobs[SCHEDULER_MAX_JOBS];
+
+public:
+    int addPeriodic(const char *name, uint32_t periodMillis, uint32_t deadlineMillis, SchedulerCallback callback, uint32_t initialDelayMillis = 0);
+    int addOneShot(const char *name, uint32_t delayMillis, uint32_t deadlineMillis, SchedulerCallback callback);
+
+    // (re)arm a job to run after delayMillis, e.g. to re-use a one-shot job
+    void trigger(int jobId, uint32_t delayMillis = 0);
+    void cancel(int jobId);
+
+    // run every job that is due, returns the number of jobs run
+    int run();
+
+    // milliseconds until the next job is due, capped at maxMillis
+    uint32_t millisUntilNextJob(uint32_t maxMillis) const;
+
+    void getInfoForLog(Logger &log) const;
+    JsonDocument getInfoForJson() const;
+    void resetStats();
+
+private:
+    int addJob(const char *name, uint32_t delayMillis, uint32_t periodMillis, uint32_t deadlineMillis, SchedulerCallback callback);
+    void runJob(Job &job, int64_t now);
+};
@@ -2,11 +2,103 @@
 
 #ifdef ENABLE_MQTT
 
-#define MQTT_CHECK_DELAY_MS 100
+#include <algorithm>
+#include <string>
+#include <lwip/sockets.h>
+#include <lwip/dns.h>
+#include <lwip/tcpip.h>
+
+static_assert(settingsSchemaValid(MQTTSettings::server, MQTTSettings::port, MQTTSettings::username,
+                                  MQTTSettings::password, MQTTSettings::topic),
+              "MQTT settings: a default is out of range or two names have the same id");
+
+// serializeJson() targets, so a document goes straight to where it is
+// sent or queued without being serialized into a String first
+
+// Collects the output in a small buffer and writes it to the client a
+// chunk at a time, rather than a socket write per character
+class ChunkedMQTTWriter : public Print
+{
+    private:
+        PubSubClient &client;
+        uint8_t chunk[MQTT_JSON_CHUNK_BYTES];
+        size_t chunkUsed = 0;
+        size_t written = 0;
+        bool failed = false;
+
+    public:
+        ChunkedMQTTWriter(PubSubClient &client) : client(client) {}
+
+        size_t write(uint8_t c) override
+        {
+            if (chunkUsed == sizeof(chunk))
+            {
+                sendChunk();
+            }
+            chunk[chunkUsed++] = c;
+            return 1;
+        }
+
+        size_t write(const uint8_t *data, size_t size) override
+        {
+            for (size_t i = 0; i < size; i++)
+            {
+                write(data[i]);
+            }
+            return size;
+        }
+
+        // sends what is left, returns the bytes the client accepted
+        size_t finish()
+        {
+            sendChunk();
+            return failed ? 0 : written;
+        }
+
+    private:
+        void sendChunk()
+        {
+            if (chunkUsed > 0 && client.write(chunk, chunkUsed) != chunkUsed)
+            {
+                failed = true;
+            }
+            written += chunkUsed;
+            chunkUsed = 0;
+        }
+};
+
+// Writes into a fixed block of memory, anything past the end is dropped
+class FixedMemoryWriter : public Print
+{
+    private:
+        uint8_t *buffer;
+        size_t capacity;
+        size_t used = 0;
+
+    public:
+        FixedMemoryWriter(uint8_t *buffer, size_t capacity) : buffer(buffer), capacity(capacity) {}
+
+        size_t write(uint8_t c) override
+        {
+            if (used == capacity)
+            {
+                return 0;
+            }
+            buffer[used++] = c;
+            return 1;
+        }
+
+        size_t write(const uint8_t *data, size_t size) override
+        {
+            size = min(size, capacity - used);
+            memcpy(buffer + used, data, size);
+            used += size;
+            return size;
+        }
+};
 
 // Initialize static members
-MQTTController::CallbackEntry MQTTController::moduleCallbacks[MAX_CALLBACKS];
-int MQTTController::callbackCount = 0;
+std::vector<MQTTController::CommandRoute> MQTTController::commandRoutes;
 
 MQTTController::MQTTController(SettingsManager &settingsManager)
     : ModuleBase(MQTT_MODULE_NAME, MQTT_MODULE_VERSION, settingsManager),
@@ -14,11 +106,11 @@ MQTTController::MQTTController(SettingsManager &settingsManager)
     mqttConnectionDesired(true),
     wifiConnected(false)
 {
-    settings.addSetting("server", new Setting<String>(MQTT_SERVER, 15));
-    settings.addSetting("port", new Setting<int>(MQTT_SERVER_PORT));
-    settings.addSetting("username", new Setting<String>(MQTT_USER, 32));
-    settings.addSetting("password", new Setting<String>(MQTT_PASS, 32));
-    settings.addSetting("topic", new Setting<String>(MQTT_TOPIC, 32));
+    serverSetting = settings.addSetting(MQTTSettings::server);
+    portSetting = settings.addSetting(MQTTSettings::port);
+    usernameSetting = settings.addSetting(MQTTSettings::username);
+    passwordSetting = settings.addSetting(MQTTSettings::password);
+    topicSetting = settings.addSetting(MQTTSettings::topic);
 
     // Remove the initialization of moduleCallbacks and callbackCount from here
 }
@@ -29,62 +121,279 @@ MQTTController::~MQTTController()
 
 void MQTTController::setup()
 {
-    // Calculate the maximum number of loops based on the timeout and delay
-    // MQTT_CONNECTION_TIMEOUT is seconds, MQTT_CHECK_DELAY_MS is milliseconds
-    mqttMaxLoops = (MQTT_CONNECTION_TIMEOUT_SECS * 1000UL) / MQTT_CHECK_DELAY_MS;
-
     mqttClient.setBufferSize(MQTT_BUFFER_SIZE);
     mqttClient.setKeepAlive(MQTT_KEEP_ALIVE);
     mqttClient.setSocketTimeout(MQTT_SOCKET_TIMEOUT);
 
     mqttClient.setCallback([this](char* topic, byte* payload, unsigned int length) {
-        String topicStr = String(topic);
-        String payloadStr = String((char*)payload, length);
-        this->onMessage(topicStr, payloadStr);
+        this->onMessage(topic, payload, length);
     });
 
+    registerCallback("settings", std::bind(&MQTTController::handleSettingsCommand, this, std::placeholders::_1, std::placeholders::_2));
+
     // Add WiFi event listener
     WiFi.onEvent(std::bind(&MQTTController::WiFiEvent, this, std::placeholders::_1));
 }
 
 int MQTTController::connect() {
     mqttConnectionDesired = true;
-    return establishConnection();
+    return getStatus();
 }
 
 void MQTTController::disconnect()
 {
+    // send whatever is queued (e.g. the "offline" status before a restart)
+    if (connectState == MQTT_STATE_CONNECTED)
+    {
+        drainQueue(outbox.getDepth());
+    }
+
     mqttConnectionDesired = false;
     mqttClient.disconnect();
+    closeConnectingSocket();
+    connectState = MQTT_STATE_IDLE;
 }
 
-int MQTTController::establishConnection()
+// Advances the connection one step per pass. The lookup and the socket
+// connect run in the background and are only polled here, so the one
+// step that blocks is the CONNECT/CONNACK exchange, for at most
+// MQTT_HANDSHAKE_TIMEOUT_SECS.
+void MQTTController::loop()
 {
     if (!wifiConnected || !mqttConnectionDesired)
     {
-        return MQTT_DISCONNECTED;
+        if (connectState != MQTT_STATE_IDLE)
+        {
+            // drop the old session, or PubSubClient still thinks it is
+            // connected and the next connect() skips sending CONNECT
+            mqttClient.disconnect();
+            wifiClient.stop();
+            closeConnectingSocket();
+            connectState = MQTT_STATE_IDLE;
+        }
+        return;
     }
 
-    if (mqttClient.state() == MQTT_CONNECTED)
+    switch (connectState)
     {
-        return MQTT_CONNECTED;
+        case MQTT_STATE_IDLE:
+            // WiFi has just come up, first attempt after a short random wait
+            consecutiveFailures = 0;
+            scheduleConnectAttempt();
+            break;
+
+        case MQTT_STATE_BACKOFF:
+            // a lookup left over from an abandoned attempt is waited out,
+            // lwIP gives up on it by itself
+            if ((long)(millis() - nextAttemptMillis) >= 0 && !lookupPending)
+            {
+                startConnectAttempt();
+            }
+            break;
+
+        case MQTT_STATE_RESOLVING:
+            if (!lookupPending)
+            {
+                openSocket();
+            }
+            break;
+
+        case MQTT_STATE_TCP_CONNECT:
+            pollSocket();
+            break;
+
+        case MQTT_STATE_HANDSHAKE:
+            completeHandshake();
+            break;
+
+        case MQTT_STATE_CONNECTED:
+            if (!mqttClient.loop())
+            {
+                setLastMessage("MQTT connection lost: " + getFriendlyStatus().second);
+                consecutiveFailures = 0;
+                scheduleConnectAttempt();
+                break;
+            }
+
+            // catch up on what was queued, a few messages per pass
+            if (!outbox.isEmpty())
+            {
+                drainQueue(MQTT_QUEUE_DRAIN_PER_PASS);
+            }
+            break;
     }
+}
 
+void MQTTController::scheduleConnectAttempt()
+{
+    // capped exponential backoff, then a random wait between half and
+    // all of it so controllers that lost the broker together don't all
+    // come back at the same moment
+    uint32_t backoff = MQTT_BACKOFF_MAX_MILLIS;
+    if (consecutiveFailures < 16)
+    {
+        backoff = min((uint32_t)MQTT_BACKOFF_MAX_MILLIS, (uint32_t)MQTT_BACKOFF_MIN_MILLIS << consecutiveFailures);
+    }
+
+    backoffMillis = backoff / 2 + random(backoff / 2 + 1);
+    nextAttemptMillis = millis() + backoffMillis;
+    connectState = MQTT_STATE_BACKOFF;
+}
+
+void MQTTController::startConnectAttempt()
+{
+    connectState = MQTT_STATE_RESOLVING;
+    connectAttempts++;
+    attemptStartCycles = LatencyHistogram::startTimer();
 
     // set topic from the settings, suffixed with the client name
-    topic = settings.getValue<String>("topic") + "/" + getClientName();
-    
-    // create a last will topic by prefixing the topic with "stat/status"
-    String lastWillTopic = topic + "/STATUS";
+    topic = topicSetting->get() + "/" + getClientName();
 
-    String server = settings.getValue<String>("server");
-    const int port = settings.getValue<int>("port");
-    String username = settings.getValue<String>("username");
-    String password = settings.getValue<String>("password");
+    topicPrefixLength = snprintf(topicBuffer, sizeof(topicBuffer), "%s/", topic.c_str());
+    if (topicPrefixLength >= sizeof(topicBuffer))
+    {
+        // rather than publish everything to the broker's root
+        Log.printfln("MQTT topic %s is too long, increase MQTT_MAX_TOPIC_LENGTH", topic.c_str());
+        topicPrefixLength = 0;
+        connectFailed("MQTT topic too long, not connecting");
+        return;
+    }
+
+    server = serverSetting->get();
+    const int port = portSetting->get();
 
-    Log.printfln("Connecting to MQTT server: %s:%d", server, port);
+    Log.printfln("Connecting to MQTT server: %s:%d", server.c_str(), port);
     mqttClient.setServer(server.c_str(), port);
 
+    // WiFiClient would look the name up and connect in one blocking call,
+    // so both are done here in the background and PubSubClient is handed
+    // a socket that is already connected
+    lookupPending = true;
+    lookupFound = false;
+    if (tcpip_callback(lookupServer, this) != ERR_OK)
+    {
+        lookupPending = false;
+        connectFailed("MQTT server lookup could not start");
+    }
+}
+
+// Runs on lwIP's thread, where its DNS client must be called. server
+// isn't touched by loop() until lookupPending is cleared.
+void MQTTController::lookupServer(void *controller)
+{
+    dns_found_callback found = [](const char *, const ip_addr_t *address, void *arg) {
+        MQTTController *self = static_cast<MQTTController *>(arg);
+        if (address != nullptr)
+        {
+            self->lookupAddress = ip4_addr_get_u32(ip_2_ip4(address));
+            self->lookupFound = true;
+        }
+        self->lookupPending = false;
+    };
+
+    MQTTController *self = static_cast<MQTTController *>(controller);
+    ip_addr_t address;
+    err_t err = dns_gethostbyname(self->server.c_str(), &address, found, self);
+    if (err == ERR_OK)
+    {
+        found(nullptr, &address, self);     // an address, or already cached
+    }
+    else if (err != ERR_INPROGRESS)
+    {
+        found(nullptr, nullptr, self);
+    }
+}
+
+// starts a non-blocking connect to the address the lookup found
+void MQTTController::openSocket()
+{
+    if (!lookupFound)
+    {
+        connectFailed("MQTT server " + server + " not found");
+        return;
+    }
+
+    connectingSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (connectingSocket < 0)
+    {
+        connectFailed("MQTT socket could not be created");
+        return;
+    }
+    fcntl(connectingSocket, F_SETFL, fcntl(connectingSocket, F_GETFL, 0) | O_NONBLOCK);
+
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(portSetting->get());
+    address.sin_addr.s_addr = lookupAddress;
+    if (lwip_connect(connectingSocket, (struct sockaddr *)&address, sizeof(address)) < 0 && errno != EINPROGRESS)
+    {
+        closeConnectingSocket();
+        connectFailed("MQTT server not reachable");
+        return;
+    }
+
+    socketStartMillis = millis();
+    connectState = MQTT_STATE_TCP_CONNECT;
+}
+
+// checks, without waiting, whether the connect has finished
+void MQTTController::pollSocket()
+{
+    fd_set writable;
+    FD_ZERO(&writable);
+    FD_SET(connectingSocket, &writable);
+    struct timeval noWait = {0, 0};
+    if (select(connectingSocket + 1, nullptr, &writable, nullptr, &noWait) <= 0)
+    {
+        if (millis() - socketStartMillis >= MQTT_CONNECT_TIMEOUT_MILLIS)
+        {
+            closeConnectingSocket();
+            connectFailed("MQTT server not reachable");
+        }
+        return;
+    }
+
+    int error = 0;
+    socklen_t length = sizeof(error);
+    if (getsockopt(connectingSocket, SOL_SOCKET, SO_ERROR, &error, &length) < 0 || error != 0)
+    {
+        closeConnectingSocket();
+        connectFailed("MQTT server refused the connection");
+        return;
+    }
+
+    // back to blocking for WiFiClient, as its own connect() leaves it
+    fcntl(connectingSocket, F_SETFL, fcntl(connectingSocket, F_GETFL, 0) & ~O_NONBLOCK);
+    int one = 1;
+    setsockopt(connectingSocket, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    wifiClient = WiFiClient(connectingSocket);
+    connectingSocket = -1;
+    wifiClient.setTimeout(MQTT_SOCKET_TIMEOUT);
+
+    // CONNECT goes on the next pass
+    connectState = MQTT_STATE_HANDSHAKE;
+}
+
+void MQTTController::closeConnectingSocket()
+{
+    if (connectingSocket >= 0)
+    {
+        close(connectingSocket);
+        connectingSocket = -1;
+    }
+}
+
+void MQTTController::completeHandshake()
+{
+    // create a last will topic by prefixing the topic with "stat/status"
+    String lastWillTopic = topic + "/STATUS";
+
+    String username = usernameSetting->get();
+    String password = passwordSetting->get();
+
+    // bound the wait for CONNACK, then back to the normal socket timeout
+    mqttClient.setSocketTimeout(MQTT_HANDSHAKE_TIMEOUT_SECS);
     mqttClient.connect(getClientName(),
                 username.c_str(), password.c_str(),
                 lastWillTopic.c_str(), 
@@ -92,47 +401,73 @@ int MQTTController::establishConnection()
                 true /* retained */, 
                 "offline", 
                 false /* clear session */);
+    mqttClient.setSocketTimeout(MQTT_SOCKET_TIMEOUT);
 
-    int loopCount = 0;
-    while (mqttClient.state() != MQTT_CONNECTED && loopCount < mqttMaxLoops)
-    {
-        Log.print(".");
-        delay(MQTT_CHECK_DELAY_MS);
-        loopCount++;
-
-        if (mqttClient.state() == MQTT_CONNECT_BAD_CREDENTIALS 
-            || mqttClient.state() == MQTT_CONNECT_UNAUTHORIZED
-            || mqttClient.state() == MQTT_CONNECT_BAD_CLIENT_ID
-            || mqttClient.state() == MQTT_CONNECT_UNAVAILABLE
-            || mqttClient.state() == MQTT_CONNECT_BAD_PROTOCOL
-            || mqttClient.state() == MQTT_CONNECT_FAILED
-            || mqttClient.state() == MQTT_CONNECTION_LOST
-            || mqttClient.state() == MQTT_CONNECTION_TIMEOUT
-            )
-        {
-            break;
-        }
+    if (mqttClient.state() != MQTT_CONNECTED)
+    {
+        wifiClient.stop();
+        connectFailed("MQTT connect failed: " + getFriendlyStatus().second);
+        return;
     }
 
-    if (mqttClient.state() != MQTT_CONNECTED)
+    uint32_t latencyMicros = connectLatency.recordSince(attemptStartCycles);
+    connectState = MQTT_STATE_CONNECTED;
+    connects++;
+    consecutiveFailures = 0;
+    backoffMillis = 0;
+
+    setLastMessage("MQTT connected successfully in " + String(latencyMicros / 1000) + " ms");
+
+    // straight out, ahead of anything queued
+    const char *online = "online";
+    send("STATUS", reinterpret_cast<const uint8_t *>(online), strlen(online), true);
+    subscribe("COMMAND/#");
+
+    if (!outbox.isEmpty())
     {
-        setLastMessage("MQTT connect failed: " + getFriendlyStatus().second);
+        drainStartMillis = millis();
+        drainMessages = 0;
     }
-    else
+}
+
+void MQTTController::drainQueue(size_t maxMessages)
+{
+    const char *queuedTopic;
+    const uint8_t *payload;
+    size_t length;
+    bool retained;
+
+    for (size_t i = 0; i < maxMessages && outbox.peek(queuedTopic, payload, length, retained); i++)
     {
-        setLastMessage("MQTT connected successfully");
-        publish("STATUS", "online", true);
-        subscribe("COMMAND/#");
+        // on failure leave it queued, loop() notices if the connection has gone
+        if (!send(queuedTopic, payload, length, retained))
+        {
+            return;
+        }
+        outbox.pop();
+        drainMessages++;
     }
 
-    return mqttClient.state();
+    if (outbox.isEmpty() && drainStartMillis != 0)
+    {
+        lastDrainMillis = millis() - drainStartMillis;
+        lastDrainMessages = drainMessages;
+        drainStartMillis = 0;
+        Log.printfln("MQTT: sent %u queued messages in %lu ms", lastDrainMessages, lastDrainMillis);
+    }
 }
 
-void MQTTController::loop()
+void MQTTController::connectFailed(const String &reason)
 {
-    mqttClient.loop();
+    connectFailures++;
+    consecutiveFailures++;
+    scheduleConnectAttempt();
+
+    setLastMessage(reason + ", retry in " + String(backoffMillis) + " ms");
 }
 
+// Called from the WiFi event task, so this only records the state and
+// loop() does the work
 void MQTTController::WiFiEvent(WiFiEvent_t event)
 {
     switch (event) {
@@ -146,20 +481,181 @@ void MQTTController::WiFiEvent(WiFiEvent_t event)
         case SYSTEM_EVENT_GOT_IP6:
             setLastMessage("WiFi connected");
             wifiConnected = true;
-            establishConnection();
         break;
     }
 }
 
 
 
+const char *MQTTController::buildTopic(const char *subTopic)
+{
+    size_t length = strlen(subTopic);
+    if (topicPrefixLength == 0)
+    {
+        return nullptr;     // no topic set, never the bare subtopic
+    }
+    if (topicPrefixLength + length >= sizeof(topicBuffer))
+    {
+        Log.printfln("MQTT topic %s is too long, increase MQTT_MAX_TOPIC_LENGTH", subTopic);
+        return nullptr;
+    }
+
+    memcpy(topicBuffer + topicPrefixLength, subTopic, length + 1);
+    return topicBuffer;
+}
+
+// false for a sub topic that won't fit after the configured prefix,
+// which is known before the first connect attempt builds it
+bool MQTTController::topicFits(const char *subTopic) const
+{
+    size_t prefixLength = topicSetting->get().length() + 1 + strlen(getClientName()) + 1;
+    return prefixLength + strlen(subTopic) < sizeof(topicBuffer);
+}
+
+bool MQTTController::send(const char *topic, const uint8_t *payload, size_t length, bool retained)
+{
+    const char *fullTopic = buildTopic(topic);
+    if (fullTopic == nullptr)
+    {
+        return false;
+    }
+
+    // too big for the client's buffer, so write it straight to the socket
+    if (MQTT_MAX_HEADER_SIZE + 2 + strlen(fullTopic) + length > mqttClient.getBufferSize())
+    {
+        return mqttClient.beginPublish(fullTopic, length, retained)
+               && mqttClient.write(payload, length) == length
+               && mqttClient.endPublish();
+    }
+    return mqttClient.publish(fullTopic, payload, length, retained);
+}
+
+bool MQTTController::sendJson(const char *topic, const JsonDocument &doc, size_t length, bool retained)
+{
+    const char *fullTopic = buildTopic(topic);
+    if (fullTopic == nullptr || !mqttClient.beginPublish(fullTopic, length, retained))
+    {
+        return false;
+    }
+
+    ChunkedMQTTWriter writer(mqttClient);
+    serializeJson(doc, writer);
+    return writer.finish() == length && mqttClient.endPublish();
+}
+
+// Sent straight away when connected, otherwise queued (replacing any
+// queued message for the same topic) and sent after reconnecting
+bool MQTTController::publish(const char *topic, const char *payload, bool retained)
+{
+    size_t length = strlen(payload);
+    const uint8_t *bytes = reinterpret_cast<const uint8_t *>(payload);
+
+    // anything already queued goes first, to keep the order
+    if (connectState == MQTT_STATE_CONNECTED && outbox.isEmpty())
+    {
+        if (send(topic, bytes, length, retained))
+        {
+            return true;
+        }
+
+        // still connected, so the message itself is the problem (too big
+        // for the buffer?), queueing it would not help
+        if (mqttClient.connected())
+        {
+            return false;
+        }
+    }
+
+    return outbox.push(topic, bytes, length, retained);
+}
+
+// Like publish(), but the document is serialized as it is sent (or
+// queued), so the only heap it needs is the document itself
+bool MQTTController::publishJson(const char *topic, const JsonDocument &doc, bool retained)
+{
+    // a topic that can never fit would never be sent, don't queue it
+    // either. Before the first connect it is queued like publish() does.
+    if (!topicFits(topic))
+    {
+        Log.printfln("MQTT topic %s is too long, increase MQTT_MAX_TOPIC_LENGTH", topic);
+        return false;
+    }
+
+    size_t length = measureJson(doc);
+
+    if (connectState == MQTT_STATE_CONNECTED && outbox.isEmpty())
+    {
+        if (sendJson(topic, doc, length, retained))
+        {
+            return true;
+        }
+
+        // part of a packet may have gone out, the connection can't be trusted
+        if (mqttClient.connected())
+        {
+            Log.printfln("MQTT: failed to send %s, reconnecting", topic);
+            mqttClient.disconnect();
+        }
+    }
+
+    uint8_t *payload = outbox.reserve(topic, length, retained);
+    if (payload == nullptr)
+    {
+        return false;
+    }
+
+    FixedMemoryWriter writer(payload, length);
+    serializeJson(doc, writer);
+    return true;
+}
+
+bool MQTTController::publishInt(const char *topic, long value, bool retained)
+{
+    char payload[24];       // room for a 64 bit long
+    snprintf(payload, sizeof(payload), "%ld", value);
+    return publish(topic, payload, retained);
+}
+
+bool MQTTController::publishFloat(const char *topic, float value, uint8_t decimals, bool retained)
+{
+    // fixed point by hand, printf("%f") can allocate in newlib
+    decimals = min(decimals, (uint8_t)6);
+    long scale = 1;
+    for (uint8_t i = 0; i < decimals; i++)
+    {
+        scale *= 10;
+    }
+
+    long scaled = lroundf(value * scale);
+    unsigned long magnitude = scaled < 0 ? -scaled : scaled;
+
+    // a sign, a 64 bit long's 20 digits, the point and the decimals,
+    // which the compiler can't tell are at most 6 digits
+    char payload[48];
+    int length;
+    if (decimals == 0)
+    {
+        length = snprintf(payload, sizeof(payload), "%ld", scaled);
+    }
+    else
+    {
+        length = snprintf(payload, sizeof(payload), "%s%lu.%0*lu", scaled < 0 ? "-" : "",
+                          magnitude / scale, (int)decimals, magnitude % scale);
+    }
+    if (length < 0 || length >= (int)sizeof(payload))
+    {
+        return false;
+    }
+    return publish(topic, payload, retained);
+}
+
 void MQTTController::publish(const String& topic, const String& payload)
 {
-    publish(topic, payload, this->topic, false);
+    publish(topic.c_str(), payload.c_str(), false);
 }
 
 void MQTTController::publish(const String &topic, const String &payload, bool retained) {
-    publish(topic, payload, this->topic, retained);
+    publish(topic.c_str(), payload.c_str(), retained);
 }
 
 
@@ -203,41 +699,76 @@ void MQTTController::unsubscribe(const String &topic, String &rootTopic)
 
 
 
-void MQTTController::onMessage(const String& topic, const String& payload)
+void MQTTController::onMessage(char *topic, const uint8_t *payload, unsigned int length)
 {
-    // Get the actual command by removing the this->topic prefix and the the word "COMMAND"
+    std::string_view payloadView(reinterpret_cast<const char *>(payload), length);
+
+    Log.printfln("MQTT message arrived [%s] %.*s", topic, (int)payloadView.size(), payloadView.data());
+
+    if (!dispatch(topic, payloadView))
+    {
+        Log.printfln("No callback registered for: %s", topic);
+    }
+}
+
+bool MQTTController::dispatch(std::string_view topic, std::string_view payload)
+{
+    // Get the actual command by removing the prefix and the word "COMMAND"
     // airflow/piv_fan/COMMAND/mode becomes "mode"
     // airflow/piv_fan/COMMAND/fan/speed becomes "fan/speed"
-    String command = topic.substring(this->topic.length() + 9);
+    static constexpr std::string_view commandMarker = "COMMAND/";
 
-    if (command.length() == 0) {
-        setLastMessage("MQTT message arrived with empty command");
-        return;
+    std::string_view prefix(topicBuffer, topicPrefixLength);
+    if (topic.size() <= prefix.size() + commandMarker.size()
+        || topic.compare(0, prefix.size(), prefix) != 0
+        || topic.compare(prefix.size(), commandMarker.size(), commandMarker) != 0)
+    {
+        return false;
     }
-
-    Log.printfln("MQTT message arrived [%s] %s", command.c_str(), payload.c_str());
+    std::string_view command = topic.substr(prefix.size() + commandMarker.size());
 
     // Split the command into the module and the command
-    int slashIndex = command.indexOf('/');
-    String module = "system";
-    if (slashIndex != -1) {
-        module = command.substring(0, slashIndex);
-        command = command.substring(slashIndex + 1);
-    }
-
-    // Check if there's a registered callback for this module
-    for (int i = 0; i < callbackCount; i++) {
-        if (moduleCallbacks[i].moduleName == module) {
-            // Execute the callback
-            moduleCallbacks[i].callback(command, payload);
-            return;
-        }
+    std::string_view module = "system";
+    size_t slashIndex = command.find('/');
+    if (slashIndex != std::string_view::npos)
+    {
+        module = command.substr(0, slashIndex);
+        command = command.substr(slashIndex + 1);
     }
 
-    Log.printfln("No callback registered for module: %s", module.c_str());
+    auto route = std::lower_bound(commandRoutes.begin(), commandRoutes.end(), module,
+                                  [](const CommandRoute &entry, std::string_view name) { return entry.moduleName < name; });
+    if (route == commandRoutes.end() || route->moduleName != module)
+    {
+        return false;
+    }
+
+    route->handler(command, payload);
+    return true;
 }
 
+// COMMAND/settings/<category>/<setting> sets a setting to the payload,
+// e.g. COMMAND/settings/FanPWM/pmwFrequency 25000. The module sees the
+// change straight away and it is saved with the other settings.
+void MQTTController::handleSettingsCommand(std::string_view command, std::string_view payload)
+{
+    size_t slashIndex = command.find('/');
+    if (slashIndex == std::string_view::npos)
+    {
+        Log.printfln("MQTT: settings command needs <category>/<setting>, got %.*s", (int)command.size(), command.data());
+        return;
+    }
+
+    SettingsCategory *category = settingsManager.getCategory(std::string(command.substr(0, slashIndex)));
+    std::string name(command.substr(slashIndex + 1));
+    if (category == nullptr || !category->setFromString(name, payload))
+    {
+        Log.printfln("MQTT: can't set %.*s to %.*s", (int)command.size(), command.data(), (int)payload.size(), payload.data());
+        return;
+    }
 
+    Log.printfln("MQTT: set %.*s to %.*s", (int)command.size(), command.data(), (int)payload.size(), payload.data());
+}
 
 void MQTTController::getInfoForLog(Logger &log) const
 {
@@ -252,18 +783,31 @@ void MQTTController::getInfoForLog(Logger &log) const
 
     PubSubClient &mqttClientRef = const_cast<PubSubClient&>(mqttClient);
 
+    log.printfln("|>  - Connect: %s, %u connects of %u attempts, %u failed in a row",
+                 getConnectStateName(), connects, connectAttempts, consecutiveFailures);
+    if (connectState == MQTT_STATE_BACKOFF)
+    {
+        log.printfln("|>  - Next attempt in %ld ms", (long)(nextAttemptMillis - millis()));
+    }
+    connectLatency.printTo(log, "conn");
+
+    log.printfln("|>  - Queue: %u messages, %u of %u bytes (high %u), %u queued, %u coalesced, %u dropped",
+                 outbox.getDepth(), outbox.getBytesUsed(), outbox.getCapacity(), outbox.getHighWaterBytes(),
+                 outbox.getQueuedCount(), outbox.getCoalescedCount(), outbox.getDroppedCount());
+    log.printfln("|>  - Last drain: %u messages in %lu ms", lastDrainMessages, lastDrainMillis);
+
     log.printfln("|>  - Buffer Size: %d", mqttClientRef.getBufferSize());
     log.printfln("|>  - Topic: %s", topic.c_str());
 
     // create a string with all the module callbacks
     String moduleCallbackNames = "";
-    for (int i = 0; i < callbackCount; i++) {
-        moduleCallbackNames += moduleCallbacks[i].moduleName + ", ";
+    for (const CommandRoute &route : commandRoutes) {
+        moduleCallbackNames += String(route.moduleName.data(), route.moduleName.size()) + ", ";
     }
     Log.printfln("|>  - Module Callbacks: %s", moduleCallbackNames.c_str());
 };
 
-String MQTTController::getInfoForJson() const
+JsonDocument MQTTController::getInfoForJson() const
 {
     JsonDocument doc = startJsonDoc();
 
@@ -275,19 +819,37 @@ String MQTTController::getInfoForJson() const
     doc["status"]["code"] = status.first;
     doc["status"]["message"] = status.second;
 
+    JsonObject connect = doc["connect"].to<JsonObject>();
+    connect["state"] = getConnectStateName();
+    connect["attempts"] = connectAttempts;
+    connect["connects"] = connects;
+    connect["failures"] = connectFailures;
+    connect["consecutiveFailures"] = consecutiveFailures;
+    connect["backoffMs"] = backoffMillis;
+    connectLatency.addToJson(connect["latencyUs"].to<JsonObject>());
+
+    JsonObject queue = doc["queue"].to<JsonObject>();
+    queue["depth"] = outbox.getDepth();
+    queue["bytes"] = outbox.getBytesUsed();
+    queue["capacity"] = outbox.getCapacity();
+    queue["highWaterBytes"] = outbox.getHighWaterBytes();
+    queue["queued"] = outbox.getQueuedCount();
+    queue["coalesced"] = outbox.getCoalescedCount();
+    queue["dropped"] = outbox.getDroppedCount();
+    queue["lastDrainMs"] = lastDrainMillis;
+    queue["lastDrainMessages"] = lastDrainMessages;
+
     PubSubClient &mqttClientRef = const_cast<PubSubClient &>(mqttClient);
     doc["bufferSize"] = mqttClientRef.getBufferSize();
     doc["topic"] = topic;
 
     JsonArray callbacks = doc["callbacks"].to<JsonArray>();
-    for (int i = 0; i < callbackCount; i++)
+    for (const CommandRoute &route : commandRoutes)
     {
-        callbacks.add(moduleCallbacks[i].moduleName);
+        callbacks.add(route.moduleName.data());    // registered from a literal, so terminated
     }
 
-    String jsonString;
-    serializeJson(doc, jsonString);
-    return jsonString;
+    return doc;
 }
 
 void MQTTController::setLastMessage(String message)
@@ -353,21 +915,48 @@ std::pair<int, String> MQTTController::getFriendlyStatus() const
     return std::make_pair(statusID, statusString);
 }
 
+const char *MQTTController::getConnectStateName() const
+{
+    switch (connectState)
+    {
+        case MQTT_STATE_IDLE:
+            return "IDLE";
+        case MQTT_STATE_BACKOFF:
+            return "BACKOFF";
+        case MQTT_STATE_RESOLVING:
+            return "RESOLVING";
+        case MQTT_STATE_TCP_CONNECT:
+            return "TCP_CONNECT";
+        case MQTT_STATE_HANDSHAKE:
+            return "HANDSHAKE";
+        case MQTT_STATE_CONNECTED:
+            return "CONNECTED";
+    }
+    return "UNKNOWN";
+}
+
 const char* MQTTController::getClientName() const
 {
     SettingsCategory *wifiSettings = settingsManager.getCategory(WIFI_MODULE_NAME);
-    return wifiSettings->getValue<String>("hostname").c_str();
+    return wifiSettings->getValue(NetworkSettings::hostname).c_str();
 }
 
 
-void MQTTController::registerCallback(const String& moduleName, std::function<void(const String&, const String&)> callback) {
-    if (callbackCount < MAX_CALLBACKS) {
-        moduleCallbacks[callbackCount] = {moduleName, callback};
-        callbackCount++;
-        Log.printfln("MQTTController::registerCallback - registered callback for module: %s", moduleName.c_str());
-    } else {
-        Log.printfln("MQTTController::registerCallback - maximum number of callbacks reached");
+void MQTTController::registerCallback(const char *moduleName, MQTTCommandHandler handler) {
+    std::string_view name(moduleName);
+
+    // keep the table sorted so dispatch() can binary search it
+    auto position = std::lower_bound(commandRoutes.begin(), commandRoutes.end(), name,
+                                     [](const CommandRoute &entry, std::string_view key) { return entry.moduleName < key; });
+    if (position != commandRoutes.end() && position->moduleName == name)
+    {
+        position->handler = handler;
+        Log.printfln("MQTTController::registerCallback - replaced callback for module: %s", moduleName);
+        return;
     }
+
+    commandRoutes.insert(position, {name, handler});
+    Log.printfln("MQTTController::registerCallback - registered callback for module: %s", moduleName);
 }
 
 #endif // ENABLE_MQTT
\ No newline at end of file
@@ -8,34 +8,103 @@
 
 #define MQTT_MODULE_NAME "MQTT"
 #define MQTT_MODULE_VERSION "1.0"
-#define MAX_CALLBACKS 10
 
 #include "settings.h"
 #include "modules/moduleBase.h"
+#include "mqttQueue.h"
 #include <WiFiClient.h>
 #include <PubSubClient.h>
+#include <string_view>
+#include <vector>
+
+// the MQTT settings, see settings/settingSpec.h
+namespace MQTTSettings
+{
+    inline constexpr SettingSpec<String> server("server", MQTT_SERVER, 15);
+    inline constexpr SettingSpec<int> port("port", MQTT_SERVER_PORT, 1, 65535);
+    inline constexpr SettingSpec<String> username("username", MQTT_USER, 32);
+    inline constexpr SettingSpec<String> password("password", MQTT_PASS, 32);
+    inline constexpr SettingSpec<String> topic("topic", MQTT_TOPIC, 32);
+}
+
+// Handles "<topic>/<client>/COMMAND/<module>/<command>" for one module.
+// The views point into PubSubClient's buffer and are only valid for the
+// duration of the call.
+typedef std::function<void(std::string_view command, std::string_view payload)> MQTTCommandHandler;
+
+// Connecting is split into steps that loop() advances one at a time,
+// and only the CONNECT/CONNACK exchange blocks, for at most
+// MQTT_HANDSHAKE_TIMEOUT_SECS
+enum MQTTConnectState {
+    MQTT_STATE_IDLE,            // no WiFi, or a connection is not wanted
+    MQTT_STATE_BACKOFF,         // waiting for the next attempt
+    MQTT_STATE_RESOLVING,       // looking up the broker's address
+    MQTT_STATE_TCP_CONNECT,     // opening the socket to the broker
+    MQTT_STATE_HANDSHAKE,       // socket open, sending CONNECT and waiting for CONNACK
+    MQTT_STATE_CONNECTED
+};
 
 
 class MQTTController : public ModuleBase
 {
     private:
-        int mqttMaxLoops = 0;
         String clientName;
         bool mqttConnectionDesired;
         bool wifiConnected;
+
+        Setting<String> *serverSetting;
+        Setting<int> *portSetting;
+        Setting<String> *usernameSetting;
+        Setting<String> *passwordSetting;
+        Setting<String> *topicSetting;
+
+        // connection state machine, see loop()
+        MQTTConnectState connectState = MQTT_STATE_IDLE;
+        String server;                          // kept, PubSubClient holds on to the pointer
+        unsigned long nextAttemptMillis = 0;
+        unsigned long backoffMillis = 0;
+        uint32_t attemptStartCycles = 0;
+
+        // the broker's name is looked up on lwIP's thread and the socket
+        // connects in the background, loop() polls for both
+        volatile bool lookupPending = false;
+        volatile bool lookupFound = false;
+        volatile uint32_t lookupAddress = 0;   // network byte order
+        int connectingSocket = -1;
+        unsigned long socketStartMillis = 0;
+
+        // connect statistics
+        unsigned int connectAttempts = 0;
+        unsigned int connects = 0;
+        unsigned int connectFailures = 0;
+        unsigned int consecutiveFailures = 0;
+        LatencyHistogram connectLatency;        // attempt start to CONNACK
+
+        // messages published while disconnected, sent after reconnecting
+        MQTTQueue outbox;
+        unsigned long drainStartMillis = 0;     // 0 when not draining
+        unsigned int drainMessages = 0;
+        unsigned long lastDrainMillis = 0;
+        unsigned int lastDrainMessages = 0;
         PubSubClient mqttClient;
         String lastMessage = "";
         WiFiClient wifiClient;
         String topic = MQTT_TOPIC;
 
-        struct CallbackEntry
+        // "<topic>/<client name>/" is written here once per connection and
+        // publish() appends the sub topic after it, so publishing doesn't
+        // build any Strings
+        char topicBuffer[MQTT_MAX_TOPIC_LENGTH] = "";
+        size_t topicPrefixLength = 0;
+
+        // sorted by module name when registered, looked up with a binary search
+        struct CommandRoute
         {
-            String moduleName;
-            std::function<void(const String &, const String &)> callback;
+            std::string_view moduleName;
+            MQTTCommandHandler handler;
         };
-        
-        static CallbackEntry moduleCallbacks[MAX_CALLBACKS];
-        static int callbackCount;
+
+        static std::vector<CommandRoute> commandRoutes;
 
     public:
         MQTTController(SettingsManager& settingsManager);
@@ -48,7 +117,15 @@ class MQTTController : public ModuleBase
         void disconnect();
 
         void getInfoForLog(Logger &log) const override;
-        String getInfoForJson() const override;
+        JsonDocument getInfoForJson() const override;
+
+        // allocation free, for telemetry that is published all the time
+        bool publish(const char *topic, const char *payload, bool retained = false);
+        bool publishInt(const char *topic, long value, bool retained = false);
+        bool publishFloat(const char *topic, float value, uint8_t decimals, bool retained = false);
+
+        // serializes the document straight into the packet (or the queue)
+        bool publishJson(const char *topic, const JsonDocument &doc, bool retained = false);
 
         void publish(const String &topic, const String &payload);
         void publish(const String &topic, const String &payload, bool retained);
@@ -65,13 +142,34 @@ class MQTTController : public ModuleBase
         int getStatus() const;
         String getLastMessage() const;
 
-        static void registerCallback(const String& moduleName, std::function<void(const String&, const String&)> callback);
+        // moduleName must outlive the controller (a string literal)
+        static void registerCallback(const char *moduleName, MQTTCommandHandler handler);
+
+        // routes a command topic to its module, false if nothing handled it
+        bool dispatch(std::string_view topic, std::string_view payload);
+
+        // "<topic>/<client name>/", empty until the first connect attempt
+        std::string_view getTopicPrefix() const { return std::string_view(topicBuffer, topicPrefixLength); }
 
     private:
-        int establishConnection();
+        void scheduleConnectAttempt();
+        void startConnectAttempt();
+        void openSocket();
+        void pollSocket();
+        void closeConnectingSocket();
+        static void lookupServer(void *controller);
+        void completeHandshake();
+        void connectFailed(const String &reason);
+        const char *getConnectStateName() const;
         void WiFiEvent(WiFiEvent_t event);
-        void onMessage(const String& topic, const String& payload);
+        void onMessage(char *topic, const uint8_t *payload, unsigned int length);
+        void handleSettingsCommand(std::string_view command, std::string_view payload);
         void setLastMessage(String message);
+        const char *buildTopic(const char *subTopic);
+        bool topicFits(const char *subTopic) const;
+        bool send(const char *topic, const uint8_t *payload, size_t length, bool retained);
+        bool sendJson(const char *topic, const JsonDocument &doc, size_t length, bool retained);
+        void drainQueue(size_t maxMessages);
 
         const char * getClientName()  const;
 
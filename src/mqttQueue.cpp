@@ -0,0 +1,105 @@
+#include "mqttQueue.h"
+
+#ifdef ENABLE_MQTT
+
+bool MQTTQueue::push(const char *topic, const uint8_t *payload, size_t length, bool retained)
+{
+    uint8_t *space = reserve(topic, length, retained);
+    if (space == nullptr)
+    {
+        return false;
+    }
+
+    memcpy(space, payload, length);
+    return true;
+}
+
+uint8_t *MQTTQueue::reserve(const char *topic, size_t length, bool retained)
+{
+    size_t topicLength = strlen(topic);
+    size_t recordLength = sizeof(RecordHeader) + topicLength + 1 + length;
+
+    if (topicLength > UINT8_MAX || recordLength > sizeof(buffer) || recordLength > UINT16_MAX)
+    {
+        dropped++;
+        return nullptr;
+    }
+
+    // only the latest value of a topic is kept
+    size_t offset = 0;
+    while (offset < used)
+    {
+        RecordHeader header = readHeader(offset);
+        const char *queuedTopic = reinterpret_cast<const char *>(buffer + offset + sizeof(RecordHeader));
+        if (header.topicLength == topicLength && memcmp(queuedTopic, topic, topicLength) == 0)
+        {
+            remove(offset);
+            coalesced++;
+            break;
+        }
+        offset += header.recordLength;
+    }
+
+    // make room by dropping the oldest
+    while (used + recordLength > sizeof(buffer))
+    {
+        remove(0);
+        dropped++;
+    }
+
+    RecordHeader header = {static_cast<uint16_t>(recordLength), static_cast<uint16_t>(length),
+                           static_cast<uint8_t>(topicLength), retained};
+    uint8_t *record = buffer + used;
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), topic, topicLength + 1);
+
+    used += recordLength;
+    depth++;
+    queued++;
+    if (used > highWaterBytes)
+    {
+        highWaterBytes = used;
+    }
+    return record + sizeof(header) + topicLength + 1;
+}
+
+bool MQTTQueue::peek(const char *&topic, const uint8_t *&payload, size_t &length, bool &retained) const
+{
+    if (depth == 0)
+    {
+        return false;
+    }
+
+    RecordHeader header = readHeader(0);
+    topic = reinterpret_cast<const char *>(buffer + sizeof(RecordHeader));
+    payload = buffer + sizeof(RecordHeader) + header.topicLength + 1;
+    length = header.payloadLength;
+    retained = header.retained;
+    return true;
+}
+
+void MQTTQueue::pop()
+{
+    if (depth > 0)
+    {
+        remove(0);
+    }
+}
+
+MQTTQueue::RecordHeader MQTTQueue::readHeader(size_t offset) const
+{
+    // records are packed, so the header may not be aligned
+    RecordHeader header;
+    memcpy(&header, buffer + offset, sizeof(header));
+    return header;
+}
+
+void MQTTQueue::remove(size_t offset)
+{
+    size_t recordLength = readHeader(offset).recordLength;
+    memmove(buffer + offset, buffer + offset + recordLength, used - offset - recordLength);
+    used -= recordLength;
+    depth--;
+}
+
+#endif // ENABLE_MQTT
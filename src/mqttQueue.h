@@ -0,0 +1,73 @@
+#pragma once
+#include "config.h"
+
+#ifdef ENABLE_MQTT
+
+#include <Arduino.h>
+
+// ----------------------------------------------------------------
+// Outbound MQTT queue
+//
+// Holds messages published while the broker is unreachable in a
+// fixed MQTT_QUEUE_BYTES buffer, oldest first. Everything we publish
+// is state (speeds, temperature, status, diagnostics), so a newer
+// message for a topic replaces the queued one and only the latest
+// value is sent after a reconnect. When the buffer is full the oldest
+// messages are dropped to make room.
+//
+// Records are packed back to back (header, topic, NUL, payload) and
+// removing one moves the rest down, so there is no heap use and no
+// fragmentation. The queue is small enough that the moves are cheap.
+// ----------------------------------------------------------------
+
+class MQTTQueue
+{
+private:
+    struct RecordHeader
+    {
+        uint16_t recordLength;      // header, topic, NUL and payload
+        uint16_t payloadLength;
+        uint8_t topicLength;
+        bool retained;
+    };
+
+    uint8_t buffer[MQTT_QUEUE_BYTES];
+    size_t used = 0;
+    size_t depth = 0;
+
+    // stats
+    uint32_t queued = 0;
+    uint32_t coalesced = 0;
+    uint32_t dropped = 0;
+    size_t highWaterBytes = 0;
+
+public:
+    // sub topic (without the device prefix), false if the message could not be kept
+    bool push(const char *topic, const uint8_t *payload, size_t length, bool retained);
+
+    // queues a message of length bytes and returns where to write the
+    // payload, so it can be produced in place. nullptr if it could not
+    // be kept. The pointer is valid until the next push(), reserve() or pop().
+    uint8_t *reserve(const char *topic, size_t length, bool retained);
+
+    // oldest message, false if the queue is empty. The pointers are
+    // valid until the next push() or pop().
+    bool peek(const char *&topic, const uint8_t *&payload, size_t &length, bool &retained) const;
+    void pop();
+
+    bool isEmpty() const { return depth == 0; }
+    size_t getDepth() const { return depth; }
+    size_t getBytesUsed() const { return used; }
+    size_t getCapacity() const { return sizeof(buffer); }
+    size_t getHighWaterBytes() const { return highWaterBytes; }
+
+    uint32_t getQueuedCount() const { return queued; }
+    uint32_t getCoalescedCount() const { return coalesced; }
+    uint32_t getDroppedCount() const { return dropped; }
+
+private:
+    RecordHeader readHeader(size_t offset) const;
+    void remove(size_t offset);
+};
+
+#endif // ENABLE_MQTT
@@ -1,8 +1,9 @@
+#include "config.h"
+
 #ifdef DEBUG_HOST
 
 #include <WiFi.h>
 #include "net_debug.h"
-#include "config.h"
 
 size_t NetworkDebugPrinter::write(uint8_t c)
 {
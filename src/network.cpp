@@ -1,14 +1,15 @@
 #include "fanController.h"
 #include "network.h"
 
-#define WIFI_CHECK_DELAY_MS 500
+static_assert(settingsSchemaValid(NetworkSettings::hostname, NetworkSettings::ssid, NetworkSettings::password),
+              "WiFi settings: a default is too long or two names have the same id");
 
 NetworkController::NetworkController(SettingsManager &settingsManager)
     : ModuleBase(WIFI_MODULE_NAME, WIFI_MODULE_VERSION, settingsManager)
 {
-    settings.addSetting("hostname", new Setting<String>(DEFAULT_DEVICE_NAME, 15));
-    settings.addSetting("ssid", new Setting<String>(DEFAULT_WIFI_SSID, 32));
-    settings.addSetting("password", new Setting<String>(DEFAULT_WIFI_PASSWORD, 63));
+    hostnameSetting = settings.addSetting(NetworkSettings::hostname);
+    ssidSetting = settings.addSetting(NetworkSettings::ssid);
+    passwordSetting = settings.addSetting(NetworkSettings::password);
 }
 
 
@@ -21,88 +22,87 @@ void NetworkController::setup()
 #ifdef ESP8266
     WiFi.hostname(DEFAULT_DEVICE_NAME);
 #else
-    WiFi.setHostname(settings.getValue<String>("hostname").c_str());
+    WiFi.setHostname(hostnameSetting->get().c_str());
 #endif
 
     // Add WiFi event listener
     WiFi.onEvent(std::bind(&NetworkController::WiFiEvent, this, std::placeholders::_1));
-
-   
-    // Calculate the maximum number of loops based on the timeout and delay
-    // WIFI_TIMEOUT is seconds, WIFI_CHECK_DELAY_MS is milliseconds
-    wifiMaxLoops = (WIFI_TIMEOUT * 1000UL) / WIFI_CHECK_DELAY_MS;
-
-    //wifiReconnectLoopCount = wifiMaxLoops * 2 / 3;
 }
 
 
+// The connection is driven by the WiFi events, loop() only deals with
+// timeouts so it costs a couple of comparisons per pass and never waits
 void NetworkController::loop()
 {
-    if (mode == NetworkMode::ACCESS_POINT) {
-        // check for connected clients and provide captive portal
+    if (status == NetworkStatus::CONNECTED)
+    {
+        // back on the configured network, the fallback AP is no longer needed
+        if (accessPointFallback)
+        {
+            stopAccessPoint();
+        }
+        return;
     }
+
+    if (!stationWanted)
+    {
+        return;
+    }
+
+    unsigned long timeoutMillis = (accessPointFallback ? WIFI_AP_RETRY_SECS : WIFI_TIMEOUT) * 1000UL;
+    if (millis() - attemptMillis < timeoutMillis)
+    {
+        return;
+    }
+    attemptMillis = millis();
+
+    // never connected since boot, so the settings are probably wrong:
+    // open the AP so they can be fixed, the station keeps trying
+    if (!connectedOnce && !accessPointFallback)
+    {
+        setLastMessage("WiFi connect timed out: " + String(WiFi.status()));
+        startAcessPoint();
+        return;
+    }
+
+    setLastMessage("WiFi still not connected, retrying");
+    connectAttempts++;
+    WiFi.reconnect();
 }
 
 
 void NetworkController::start() {
-    if (connect() != NetworkStatus::CONNECTED)
+    if (connect() == NetworkStatus::FAILED)
     {
         startAcessPoint();
     }
 }
 
+// Starts connecting and returns straight away, the result arrives
+// through WiFiEvent()
 NetworkStatus NetworkController::connect()
 {
-    if (mode == NetworkMode::ACCESS_POINT) {
-        WiFi.softAPdisconnect();
-    }
-
-    mode = NetworkMode::STATION;
-    String ssid = settings.getValue<String>("ssid");
+    String ssid = ssidSetting->get();
 
     if (ssid == "")
     {
         setLastMessage("No WiFi SSID configured");
         status = NetworkStatus::FAILED;
+        stationWanted = false;
         return NetworkStatus::FAILED;
     }
 
     Log.printfln("Connecting to WiFi - SSID: %s", ssid.c_str());
     Log.printfln("MAC: %s", WiFi.macAddress().c_str());
 
-    WiFi.mode(WIFI_STA);
-    WiFi.begin(ssid, settings.getValue<String>("password"));
+    stationWanted = true;
+    status = NetworkStatus::CONNECTING;
+    disconnectedMillis = millis();
+    attemptMillis = disconnectedMillis;
+    connectAttempts++;
 
-    int wifiLoopCount = 0;
-    while (WiFi.status() != WL_CONNECTED && wifiLoopCount < wifiMaxLoops)
-    {
-        Log.print(".");
-        //Log.printfln("%d : %d", wifiLoopCount, static_cast<int>(WiFi.status()));
-
-        if (WiFi.status() == WL_NO_SSID_AVAIL)
-        {
-            setLastMessage("WiFi SSID not available");
-            break;
-        }
-
-        delay(WIFI_CHECK_DELAY_MS);
-        wifiLoopCount += 1;
-
-        // // Try a reconnect when 2/3rds of loops are complete
-        // if (wifiLoopCount == wifiReconnectLoopCount)
-        // {
-        //     WiFi.reconnect();
-        // }
-    }
-
-    if (WiFi.status() != WL_CONNECTED)
-    {
-        status = NetworkStatus::FAILED;
-        setLastMessage("WiFi connect failed: " + String(WiFi.status()));
-    } else {
-        status = NetworkStatus::CONNECTED;
-        Log.println("Wifi connected successfully");
-    }
+    WiFi.mode(accessPointFallback ? WIFI_AP_STA : WIFI_STA);
+    WiFi.begin(ssid, passwordSetting->get());
 
     return status;
 }
@@ -114,14 +114,24 @@ void NetworkController::startAcessPoint()
     Log.println("Starting Access Point");
     mode = NetworkMode::ACCESS_POINT;
 
+    accessPointFallback = true;
+
     WiFi.softAPConfig(IPAddress(4, 3, 2, 1), IPAddress(4, 3, 2, 1), IPAddress(255, 255, 255, 0));
     WiFi.softAP(AP_DEFAULT_SSID, AP_DEFAULT_PASS, 1, false);
 #else
-    NetworkStatusstatus = NetworkStatus::FAILED;
-    Log.println("WiFi AP mode not enabled. Reboot to try again.");
+    // stays in station mode, loop() keeps retrying every WIFI_TIMEOUT
+    connectedOnce = true;
+    Log.println("WiFi AP mode not enabled, retrying the station");
 #endif
 }
 
+void NetworkController::stopAccessPoint()
+{
+    Log.println("Stopping Access Point");
+    accessPointFallback = false;
+    WiFi.softAPdisconnect();
+}
+
 
 
 
@@ -156,13 +166,22 @@ void NetworkController::WiFiEvent(WiFiEvent_t event)
             break;
 
         case SYSTEM_EVENT_STA_CONNECTED:
-            status = NetworkStatus::CONNECTED;
+            // associated, but not connected until DHCP gives us an
+            // address, so the attempt's timeout covers that as well
+            status = NetworkStatus::CONNECTING;
             setLastMessage("WiFi Connected to SSID: " + WiFi.SSID());
             Log.printfln("WiFi strength: %d%% (%d dBm)", getSignalQuality(WiFi.RSSI()), WiFi.RSSI());
             Log.printfln("MAC: %s", WiFi.macAddress().c_str());
             break;
 
         case SYSTEM_EVENT_STA_DISCONNECTED:
+            // start timing the outage, the driver reconnects by itself
+            // and loop() retries if it is taking too long
+            if (status == NetworkStatus::CONNECTED)
+            {
+                disconnectedMillis = millis();
+                attemptMillis = disconnectedMillis;
+            }
             status = NetworkStatus::DISCONNECTED;
             setLastMessage("WiFi Disconnected");
             break;
@@ -170,13 +189,30 @@ void NetworkController::WiFiEvent(WiFiEvent_t event)
         case SYSTEM_EVENT_STA_GOT_IP:
             status = NetworkStatus::CONNECTED;
             setLastMessage("IP: " + WiFi.localIP().toString());
+            if (stationWanted)
+            {
+                lastTimeToConnectMillis = millis() - disconnectedMillis;
+                if (lastTimeToConnectMillis > maxTimeToConnectMillis)
+                {
+                    maxTimeToConnectMillis = lastTimeToConnectMillis;
+                }
+                connects++;
+                connectedOnce = true;
+                Log.printfln("WiFi connected in %lu ms", lastTimeToConnectMillis);
+            }
             break;
 
         case SYSTEM_EVENT_GOT_IP6:
+            status = NetworkStatus::CONNECTED;
             setLastMessage("WiFi Got IP6");
             break;
 
         case SYSTEM_EVENT_STA_LOST_IP:
+            if (status == NetworkStatus::CONNECTED)
+            {
+                disconnectedMillis = millis();
+                attemptMillis = disconnectedMillis;
+            }
             status = NetworkStatus::CONNECTING;
             setLastMessage("WiFi Lost IP");
             break;
@@ -196,7 +232,7 @@ void NetworkController::WiFiEvent(WiFiEvent_t event)
             break;
 
         case SYSTEM_EVENT_AP_STOP:
-            mode = NetworkMode::OFF;
+            mode = (WiFi.getMode() == WIFI_MODE_STA) ? NetworkMode::STATION : NetworkMode::OFF;
             setLastMessage("WiFi AP Stop");
             break;
 
@@ -229,6 +265,8 @@ void NetworkController::getInfoForLog(Logger &log) const
     log.printfln("|>  - Status: %d (%s)", statusInfo.first, statusInfo.second.c_str());
 
     log.printfln("|>  - Last: %s", lastMessage.c_str());
+    log.printfln("|>  - Connects: %u of %u attempts, time to connect last %lu ms, max %lu ms",
+                 connects, connectAttempts, lastTimeToConnectMillis, maxTimeToConnectMillis);
 
     if (mode == NetworkMode::OFF) {
         log.println("|>  - WiFi is OFF");
@@ -255,7 +293,7 @@ void NetworkController::getInfoForLog(Logger &log) const
     }
 }
 
-String NetworkController::getInfoForJson() const
+JsonDocument NetworkController::getInfoForJson() const
 {
     JsonDocument doc = startJsonDoc();
 
@@ -267,6 +305,11 @@ String NetworkController::getInfoForJson() const
 
     doc["lastMessage"] = lastMessage;
 
+    doc["connect"]["attempts"] = connectAttempts;
+    doc["connect"]["connects"] = connects;
+    doc["connect"]["lastTimeToConnectMs"] = lastTimeToConnectMillis;
+    doc["connect"]["maxTimeToConnectMs"] = maxTimeToConnectMillis;
+
     if (mode == NetworkMode::OFF)
     {
         doc["state"] = "OFF";
@@ -297,9 +340,7 @@ String NetworkController::getInfoForJson() const
         doc["softap"]["ssid"] = WiFi.softAPSSID();
     }
 
-    String jsonString;
-    serializeJson(doc, jsonString);
-    return jsonString;
+    return doc;
 }
 
 
@@ -8,6 +8,14 @@
 #include "settings.h"
 #include "modules/moduleBase.h"
 
+// the WiFi settings, see settings/settingSpec.h
+namespace NetworkSettings
+{
+    inline constexpr SettingSpec<String> hostname("hostname", DEFAULT_DEVICE_NAME, 15);
+    inline constexpr SettingSpec<String> ssid("ssid", DEFAULT_WIFI_SSID, 32);
+    inline constexpr SettingSpec<String> password("password", DEFAULT_WIFI_PASSWORD, 63);
+}
+
 #ifdef ESP8266
     #include <ESP8266WiFi.h>
     #include <ESP8266mDNS.h>
@@ -36,10 +44,23 @@ class NetworkController : public ModuleBase
         NetworkMode mode = NetworkMode::OFF;
         String lastMessage = "";
 
-        // connection variables
-        short wifiMaxLoops = 0;
-        //short wifiReconnectLoopCount = 0;
-        
+        Setting<String> *hostnameSetting;
+        Setting<String> *ssidSetting;
+        Setting<String> *passwordSetting;
+
+        // connection state, driven by WiFiEvent() with timeouts in loop()
+        bool stationWanted = false;             // connect() called, keep the station connected
+        bool connectedOnce = false;             // fall back to the AP only if we never connected
+        bool accessPointFallback = false;
+        unsigned long disconnectedMillis = 0;   // start of the boot connect or the outage
+        unsigned long attemptMillis = 0;        // start of the current attempt
+
+        // time-to-connected, from connect() or the link dropping until we have an IP
+        unsigned int connectAttempts = 0;
+        unsigned int connects = 0;
+        unsigned long lastTimeToConnectMillis = 0;
+        unsigned long maxTimeToConnectMillis = 0;
+
 
     public:
         NetworkController(SettingsManager& settingsManager);
@@ -53,13 +74,14 @@ class NetworkController : public ModuleBase
         void reconnect();
 
         void startAcessPoint();
+        void stopAccessPoint();
 
         bool isConnected() const;
         wl_status_t getStatus() const;
         String getLastMessage() const;
 
         void getInfoForLog(Logger &log) const override;
-        String getInfoForJson() const override;
+        JsonDocument getInfoForJson() const override;
 
 
     private:
@@ -5,9 +5,9 @@
 #include <map>
 #include <string>
     
-#include "settings/SettingBase.h"
-#include "settings/Setting.h"
-#include "settings/SettingsCategory.h"
-#include "settings/SettingsManager.h"
+#include "settings/settingBase.h"
+#include "settings/setting.h"
+#include "settings/settingsCategory.h"
+#include "settings/settingsManager.h"
 
 extern SettingsManager settingsManager;
\ No newline at end of file
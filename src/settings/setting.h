@@ -1,41 +1,137 @@
 #pragma once
-#include "SettingBase.h"
+#include "settingBase.h"
+#include "settingSpec.h"
 #include <ArduinoJson.h>
+#include <charconv>
+#include <cstdlib>
 #include <cstring>
+#include <functional>
+#include <limits>
+#include <vector>
 
 template <typename T>
 class Setting : public SettingBase
 {
+public:
+    typedef std::function<void(const T &)> ChangeCallback;
+
 private:
     T value;
-    size_t maxLength; // size of the data type, or max length of the string
+    const SettingSpec<T> &spec;     // name, default and range, see settingSpec.h
+    std::vector<ChangeCallback> listeners;
 
 public:
-    Setting(T defaultValue)
-        : SettingBase(), value(defaultValue), maxLength(sizeof(T)) {}
-
-    Setting(T defaultValue, size_t maxLen )
-        : SettingBase(), value(defaultValue), maxLength(maxLen) {}
+    // a string's buffer is allocated once, at its longest, so changing
+    // it later doesn't touch the heap
+    explicit Setting(const SettingSpec<T> &spec)
+        : SettingBase(settingTypeOf<T>()), value(spec.defaultValue), spec(spec)
+    {
+        if constexpr (std::is_same<T, String>::value)
+        {
+            value.reserve(spec.maxLength);
+        }
+    }
 
-    void setValue(T newValue)
+    // false if newValue is out of the setting's range, a string that is
+    // too long is cut to its longest length instead
+    bool setValue(T newValue)
     {
+        if constexpr (!std::is_same<T, String>::value)
+        {
+            if (!spec.isValid(newValue))
+            {
+                return false;
+            }
+        }
+
         if (value != newValue) {
             if constexpr (std::is_same<T, String>::value)
             {
-                value = newValue.substring(0, maxLength);
+                value = "";
+                value.concat(newValue.c_str(), min((size_t)newValue.length(), spec.maxLength));
             }
             else
             {
                 value = newValue;
             }
-            dirty = true;
+            setDirty(true);
+
+            for (const ChangeCallback &listener : listeners)
+            {
+                listener(value);
+            }
+        }
+        return true;
+    }
+
+    const char *getName() const { return spec.name; }
+    const SettingSpec<T> &getSpec() const { return spec; }
+
+    // callback is called with the new value whenever setValue() changes
+    // it. Loading the saved settings at boot doesn't call it, so read
+    // the value in setup() and subscribe there.
+    void onChange(ChangeCallback callback)
+    {
+        listeners.push_back(std::move(callback));
+    }
+
+    bool setFromString(std::string_view text) override
+    {
+        if constexpr (std::is_same<T, String>::value)
+        {
+            if (text.size() > spec.maxLength)
+            {
+                return false;
+            }
+            setValue(String(text.data(), text.size()));
+        }
+        else if constexpr (std::is_same<T, bool>::value)
+        {
+            if (text == "1" || text == "true")
+                return setValue(true);
+            else if (text == "0" || text == "false")
+                return setValue(false);
+            else
+                return false;
+        }
+        else if constexpr (std::is_same<T, float>::value)
+        {
+            char buffer[24];
+            if (text.empty() || text.size() >= sizeof(buffer))
+            {
+                return false;
+            }
+            memcpy(buffer, text.data(), text.size());
+            buffer[text.size()] = '\0';
+            char *end;
+            float parsed = strtof(buffer, &end);
+            if (*end != '\0')
+            {
+                return false;
+            }
+            return setValue(parsed);
+        }
+        else
+        {
+            long long parsed;
+            auto result = std::from_chars(text.data(), text.data() + text.size(), parsed);
+            if (result.ec != std::errc() || result.ptr != text.data() + text.size() ||
+                parsed < std::numeric_limits<T>::min() || parsed > std::numeric_limits<T>::max())
+            {
+                return false;
+            }
+            return setValue((T)parsed);
         }
+        return true;
     }
 
 
 
     const T* getValue() const { return &value; }
 
+    // for modules holding the pointer returned by addSetting()
+    const T &get() const { return value; }
+
 
 
     std::string getValueAsString() const
@@ -58,29 +154,80 @@ public:
 
 
 
-    void toJson(JsonObject& json, const std::string& name) override
+    void toJson(JsonObject& json, const std::string& name) const override
     {
         json[name] = value;
-        dirty = false;
-
-        //Log.printfln("toJson %s: %s, dirty=%d", name.c_str(), value.c_str(), dirty);
     };
 
+    // an import, so a changed value is dirty and gets saved
     void fromJson(const JsonObject& json, const std::string& name) override
     {
         if (json[name].is<T>()) {
             setValue(json[name].as<T>());
-            dirty = false;
+        }
+    }
+
+    // the value as it is in memory, strings without the terminator
+    size_t valueLength() const override
+    {
+        if constexpr (std::is_same<T, String>::value)
+        {
+            return min((size_t)value.length(), spec.maxLength);
+        }
+        else
+        {
+            return sizeof(T);
+        }
+    }
 
-            //Log.printfln("fromJson %s: %s, dirty=%d", name.c_str(), value.c_str(), dirty);
+    void writeValue(uint8_t *buffer) const override
+    {
+        if constexpr (std::is_same<T, String>::value)
+        {
+            memcpy(buffer, value.c_str(), valueLength());
+        }
+        else
+        {
+            memcpy(buffer, &value, sizeof(T));
+        }
+    }
+
+    bool readValue(const uint8_t *data, size_t length) override
+    {
+        if constexpr (std::is_same<T, String>::value)
+        {
+            if (length > spec.maxLength)
+            {
+                return false;
+            }
+            value = "";
+            value.concat(data, length);
+        }
+        else
+        {
+            T stored;
+            if (length != sizeof(T))
+            {
+                return false;
+            }
+            memcpy(&stored, data, sizeof(T));
+
+            // saved by firmware that allowed a wider range, keep the default
+            if (!spec.isValid(stored))
+            {
+                return false;
+            }
+            value = stored;
         }
+        setDirty(false);
+        return true;
     }
 
     size_t size() const override
     {
         if constexpr (std::is_same<T, String>::value)
         {
-            return maxLength + 1; // +1 for null terminator
+            return spec.maxLength + 1; // +1 for null terminator
         }
         else
         {
@@ -1,21 +1,133 @@
 #pragma once
+#include <Arduino.h>
 #include <ArduinoJson.h>
 #include <string>
+#include <string_view>
+#include <type_traits>
+
+// Type of the value a setting holds, checked whenever a setting is
+// looked up by name so a Setting<int> can't be read as a Setting<byte>
+enum SettingType : uint8_t
+{
+    SETTING_TYPE_BOOL,
+    SETTING_TYPE_INT8,
+    SETTING_TYPE_UINT8,
+    SETTING_TYPE_INT16,
+    SETTING_TYPE_UINT16,
+    SETTING_TYPE_INT32,
+    SETTING_TYPE_UINT32,
+    SETTING_TYPE_FLOAT,
+    SETTING_TYPE_STRING
+};
+
+// tag for T, integers by size and sign (int and long are the same
+// thing on the ESP32), anything else doesn't compile
+template <typename T>
+constexpr SettingType settingTypeOf()
+{
+    if constexpr (std::is_same<T, bool>::value)
+        return SETTING_TYPE_BOOL;
+    else if constexpr (std::is_same<T, String>::value)
+        return SETTING_TYPE_STRING;
+    else if constexpr (std::is_same<T, float>::value)
+        return SETTING_TYPE_FLOAT;
+    else
+    {
+        static_assert(std::is_integral<T>::value && sizeof(T) <= 4, "unsupported setting type");
+        if constexpr (sizeof(T) == 1)
+            return std::is_signed<T>::value ? SETTING_TYPE_INT8 : SETTING_TYPE_UINT8;
+        else if constexpr (sizeof(T) == 2)
+            return std::is_signed<T>::value ? SETTING_TYPE_INT16 : SETTING_TYPE_UINT16;
+        else
+            return std::is_signed<T>::value ? SETTING_TYPE_INT32 : SETTING_TYPE_UINT32;
+    }
+}
+
+// Number of dirty settings in a category, or in every category for the
+// manager's. A setting changes its category's count when it becomes
+// dirty or clean, which passes the change up to the manager's, so
+// checking for anything to save is a compare rather than a walk over
+// every setting.
+struct SettingsDirtyCount
+{
+    uint32_t dirty = 0;
+    SettingsDirtyCount *parent = nullptr;
+
+    void add(int delta)
+    {
+        dirty += delta;
+        if (parent != nullptr)
+        {
+            parent->add(delta);
+        }
+    }
+};
 
 class SettingBase
 {
-    protected:
+    private:
         bool dirty = false;
+        SettingsDirtyCount *dirtyCount = nullptr;     // the category's
+
+    protected:
+        const SettingType type;
+
+        void setDirty(bool isDirty)
+        {
+            if (dirty != isDirty)
+            {
+                dirty = isDirty;
+                if (dirtyCount != nullptr)
+                {
+                    dirtyCount->add(isDirty ? 1 : -1);
+                }
+            }
+        }
+
 public:
-    virtual void toJson(JsonObject &json, const std::string &name) = 0;
+    // JSON is only for export (and importing old saved settings)
+    virtual void toJson(JsonObject &json, const std::string &name) const = 0;
     virtual void fromJson(const JsonObject &json, const std::string &name) = 0;
     virtual size_t size() const = 0;
+
+    // binary value for the saved settings, see settingsFormat.h.
+    // writeValue() writes valueLength() bytes, readValue() is false
+    // if the data isn't a valid value
+    virtual size_t valueLength() const = 0;
+    virtual void writeValue(uint8_t *buffer) const = 0;
+    virtual bool readValue(const uint8_t *data, size_t length) = 0;
     virtual std::string getValueAsString() const = 0;
 
+    // parses text (e.g. from an MQTT command) as the value and sets it,
+    // false if it isn't a valid value
+    virtual bool setFromString(std::string_view text) = 0;
+
+
+    SettingBase(SettingType type) : dirty(true), type(type) {}
+
+    // called once, by the category the setting is added to
+    void attach(SettingsDirtyCount *count)
+    {
+        dirtyCount = count;
+        if (dirty)
+        {
+            dirtyCount->add(1);
+        }
+    }
 
-    SettingBase() : dirty(true) {}
+    SettingType getType() const {
+        return type;
+    };
 
     bool isDirty() const {
         return dirty;
     };
-};
\ No newline at end of file
+
+    void clearDirty() {
+        setDirty(false);
+    };
+
+    void markDirty() {
+        setDirty(true);
+    };
+};
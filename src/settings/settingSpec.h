@@ -0,0 +1,98 @@
+#pragma once
+#include <Arduino.h>
+#include <limits>
+#include <string>
+#include "settingsFormat.h"
+
+// ----------------------------------------------------------------
+// Settings schema
+//
+// A module declares each of its settings once, as an inline constexpr
+// SettingSpec in its header: the name, the type, the default and the
+// range of valid values (the longest length for a string). addSetting()
+// creates the setting from its spec, so the type is never spelled out
+// twice and can't disagree, and a value outside the range is refused
+// whether it comes from a command, the saved settings or an import.
+//
+// The id a setting is saved under is the hash of its name, worked out
+// when the spec is compiled. A module checks its schema with
+//
+//   static_assert(settingsSchemaValid(spec, spec, ...), "...");
+//
+// which fails the build if a default is out of its range (or too long)
+// or two names in the module have the same id.
+// ----------------------------------------------------------------
+
+template <typename T>
+struct SettingSpec
+{
+    const char *name;
+    uint32_t id;
+    T defaultValue;
+    T min;
+    T max;
+
+    // any value of the type
+    constexpr SettingSpec(const char *name, T defaultValue)
+        : SettingSpec(name, defaultValue, std::numeric_limits<T>::lowest(), std::numeric_limits<T>::max()) {}
+
+    constexpr SettingSpec(const char *name, T defaultValue, T min, T max)
+        : name(name), id(settingsNameId(name)), defaultValue(defaultValue), min(min), max(max) {}
+
+    constexpr bool isValid(const T &value) const
+    {
+        return value >= min && value <= max;
+    }
+
+    constexpr bool defaultIsValid() const
+    {
+        return isValid(defaultValue);
+    }
+};
+
+template <>
+struct SettingSpec<String>
+{
+    const char *name;
+    uint32_t id;
+    const char *defaultValue;
+    size_t maxLength;
+
+    constexpr SettingSpec(const char *name, const char *defaultValue, size_t maxLength)
+        : name(name), id(settingsNameId(name)), defaultValue(defaultValue), maxLength(maxLength) {}
+
+    bool isValid(const String &value) const
+    {
+        return value.length() <= maxLength;
+    }
+
+    constexpr bool defaultIsValid() const
+    {
+        return std::char_traits<char>::length(defaultValue) <= maxLength;
+    }
+};
+
+// every default valid and every id different
+template <typename... Specs>
+constexpr bool settingsSchemaValid(const Specs &...specs)
+{
+    const bool defaultsValid[] = {specs.defaultIsValid()...};
+    const uint32_t ids[] = {specs.id...};
+    constexpr size_t count = sizeof...(Specs);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!defaultsValid[i])
+        {
+            return false;
+        }
+        for (size_t j = i + 1; j < count; j++)
+        {
+            if (ids[i] == ids[j])
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <Arduino.h>
+#include <cstddef>
+#include "../config.h"
+
+// ----------------------------------------------------------------
+// Settings arena
+//
+// Every Setting<T> is constructed in this one static block rather than
+// on the heap. Settings live as long as the firmware, so nothing is
+// ever freed and allocating is moving an offset along the block.
+//
+// Modules add their settings from their constructors, which run during
+// static initialisation, so the block and offset are zero-initialised
+// statics that are usable before any constructor has run.
+// ----------------------------------------------------------------
+
+class SettingsArena
+{
+private:
+    alignas(std::max_align_t) static inline uint8_t block[SETTINGS_ARENA_BYTES];
+    static inline size_t used = 0;
+    static inline uint32_t overflows = 0;   // settings that didn't fit and went on the heap
+
+public:
+    // nullptr when the block is full
+    static void *allocate(size_t size, size_t alignment)
+    {
+        size_t offset = (used + alignment - 1) & ~(alignment - 1);
+        if (offset + size > SETTINGS_ARENA_BYTES)
+        {
+            overflows++;
+            return nullptr;
+        }
+        used = offset + size;
+        return block + offset;
+    }
+
+    static size_t getUsed() { return used; }
+    static size_t getCapacity() { return SETTINGS_ARENA_BYTES; }
+    static uint32_t getOverflows() { return overflows; }
+};
@@ -2,35 +2,113 @@
 #include <ArduinoJson.h>
 #include <string>
 #include <map>
-#include "SettingBase.h"
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include <new>
+#include <utility>
+#include "settingBase.h"
+#include "settingsArena.h"
+#include "settingSpec.h"
+#include "settingsFormat.h"
 #include "logger.h"
-#include <typeinfo> // Include this for typeid
 
 class SettingsCategory
 {
 private:
     std::map<std::string, SettingBase*> settings;
+    SettingsDirtyCount dirtyCount;
+
+    // the settings by id (the hash of the name, see settingsFormat.h),
+    // worked out once as they are added, so loading matches a record
+    // to its setting without hashing or comparing names
+    std::vector<std::pair<uint32_t, SettingBase*>> settingsById;
+
+    SettingBase *findById(uint32_t id) const
+    {
+        auto it = std::lower_bound(settingsById.begin(), settingsById.end(), id,
+                                   [](const std::pair<uint32_t, SettingBase*> &entry, uint32_t id) { return entry.first < id; });
+        return it != settingsById.end() && it->first == id ? it->second : nullptr;
+    }
 
 public:
+    // called once, by the manager, to pass changes on to its count
+    void attach(SettingsDirtyCount *managerCount)
+    {
+        dirtyCount.parent = managerCount;
+        managerCount->add(dirtyCount.dirty);
+    }
+
+    // constructs the setting for spec (see settingSpec.h) in the
+    // settings arena and returns it, keep it and read it with get()
+    // rather than looking it up each time
     template <typename T>
-    void addSetting(const std::string &name, Setting<T> *setting)
+    Setting<T> *addSetting(const SettingSpec<T> &spec)
     {
-        settings[name] = setting;
+        Setting<T> *setting;
+        if (void *storage = SettingsArena::allocate(sizeof(Setting<T>), alignof(Setting<T>)))
+        {
+            setting = new (storage) Setting<T>(spec);
+        }
+        else
+        {
+            Log.printfln("ERROR! Settings arena full, %s is on the heap", spec.name);
+            setting = new Setting<T>(spec);
+        }
+        settings[spec.name] = setting;
+        setting->attach(&dirtyCount);
+
+        auto position = std::lower_bound(settingsById.begin(), settingsById.end(), spec.id,
+                                         [](const std::pair<uint32_t, SettingBase*> &entry, uint32_t id) { return entry.first < id; });
+        if (position != settingsById.end() && position->first == spec.id)
+        {
+            Log.printfln("ERROR! Setting %s has the same id as another, it won't be saved", spec.name);
+        }
+        else
+        {
+            settingsById.insert(position, {spec.id, setting});
+        }
+        return setting;
     }
 
     template <typename T>
-    const T &getValue(const std::string &name) const
+    Setting<T> *getSetting(const std::string &name) const
     {
         auto it = settings.find(name);
-        if (it != settings.end()) {
-            if (const auto* typedSetting = static_cast<const Setting<T>*>(it->second)) {
-                    return *typedSetting->getValue();
-            }
-            else {
-                throw std::runtime_error("Type mismatch for setting: " + name);
-            }
+        if (it == settings.end()) {
+            throw std::out_of_range("Setting not found: " + name);
         }
-        throw std::out_of_range("Setting not found: " + name);
+        if (it->second->getType() != settingTypeOf<T>()) {
+            throw std::runtime_error("Type mismatch for setting: " + name);
+        }
+        return static_cast<Setting<T>*>(it->second);
+    }
+
+    // by another module's spec, so the type comes from the spec and the
+    // lookup is by its id rather than the name
+    template <typename T>
+    Setting<T> *getSetting(const SettingSpec<T> &spec) const
+    {
+        SettingBase *setting = findById(spec.id);
+        if (setting == nullptr) {
+            throw std::out_of_range(std::string("Setting not found: ") + spec.name);
+        }
+        if (setting->getType() != settingTypeOf<T>()) {
+            throw std::runtime_error(std::string("Type mismatch for setting: ") + spec.name);
+        }
+        return static_cast<Setting<T>*>(setting);
+    }
+
+    template <typename T>
+    const T &getValue(const SettingSpec<T> &spec) const
+    {
+        return getSetting(spec)->get();
+    }
+
+    template <typename T>
+    const T &getValue(const std::string &name) const
+    {
+        return getSetting<T>(name)->get();
     }
 
     // Add this overload for string literals
@@ -44,8 +122,8 @@ public:
     {
         auto it = settings.find(name);
         if (it != settings.end()) {
-            if (Setting<T>* typedSetting = static_cast<Setting<T>*>(it->second)) {
-                typedSetting->setValue(value);
+            if (it->second->getType() == settingTypeOf<T>()) {
+                static_cast<Setting<T>*>(it->second)->setValue(value);
             } else {
                 throw std::runtime_error("Type mismatch for setting: " + name);
             }
@@ -55,7 +133,12 @@ public:
         }
     }
 
-    
+    // false if there is no such setting or text isn't a valid value
+    bool setFromString(const std::string &name, std::string_view text)
+    {
+        auto it = settings.find(name);
+        return it != settings.end() && it->second->setFromString(text);
+    }
 
     void toJson(JsonObject &json) const
     {
@@ -73,14 +156,107 @@ public:
         }
     }
 
-    bool isDirty() const
+    // appends a record per setting, returns the bytes written or 0 if
+    // they don't all fit
+    size_t writeBinary(uint8_t *buffer, size_t capacity) const
+    {
+        size_t offset = 0;
+        for (const auto &[id, setting] : settingsById)
+        {
+            size_t length = setting->valueLength();
+            if (offset + sizeof(SettingRecordHeader) + length > capacity)
+            {
+                return 0;
+            }
+
+            SettingRecordHeader record = {id, setting->getType(), (uint8_t)length};
+            memcpy(buffer + offset, &record, sizeof(record));
+            setting->writeValue(buffer + offset + sizeof(record));
+            offset += sizeof(record) + length;
+        }
+        return offset;
+    }
+
+    // loads the records that match a setting by id and type, the rest
+    // keep their defaults. The values are read straight from data, in
+    // one pass. Returns the number of settings loaded.
+    int readBinary(const uint8_t *data, size_t length)
     {
+        int loaded = 0;
+        size_t offset = 0;
+        while (offset + sizeof(SettingRecordHeader) <= length)
+        {
+            SettingRecordHeader record;
+            memcpy(&record, data + offset, sizeof(record));
+            const uint8_t *value = data + offset + sizeof(record);
+            offset += sizeof(record) + record.length;
+            if (offset > length)
+            {
+                break;
+            }
+
+            SettingBase *setting = findById(record.settingId);
+            if (setting != nullptr && record.type == setting->getType() && setting->readValue(value, record.length))
+            {
+                loaded++;
+            }
+        }
+        return loaded;
+    }
+
+    // bytes writeBinary() needs
+    size_t binarySize() const
+    {
+        size_t total = 0;
+        for (const auto &pair : settings)
+        {
+            total += sizeof(SettingRecordHeader) + pair.second->valueLength();
+        }
+        return total;
+    }
+
+    // value bytes of the settings that changed since the last save
+    size_t getDirtyBytes() const
+    {
+        size_t total = 0;
         for (const auto &pair : settings)
         {
             if (pair.second->isDirty())
-                return true;
+            {
+                total += pair.second->valueLength();
+            }
         }
-        return false;
+        return total;
+    }
+
+    bool empty() const
+    {
+        return settings.empty();
+    }
+
+    void clearDirty()
+    {
+        if (!isDirty())
+        {
+            return;
+        }
+        for (const auto &pair : settings)
+        {
+            pair.second->clearDirty();
+        }
+    }
+
+    void markDirty()
+    {
+        for (const auto &pair : settings)
+        {
+            pair.second->markDirty();
+        }
+    }
+
+    bool isDirty() const
+    {
+        return dirtyCount.dirty > 0;
     }
 
     size_t size() const
@@ -0,0 +1,85 @@
+#pragma once
+#include <Arduino.h>
+#include <stddef.h>
+#include <esp_rom_crc.h>
+
+// ----------------------------------------------------------------
+// Binary settings format
+//
+//   NVS slot:  slot header, then the category's records
+//   record:    setting id, type, length, then the value bytes
+//
+// Each category has two slots, A and B. A save goes to the slot not
+// holding the newest copy, with the next generation number, so a save
+// cut short by a power loss leaves the previous copy intact. Loading
+// reads both and uses the newest one whose CRC matches. Slot A is the
+// category name, where firmware before the slots saved a version byte
+// followed by the records; that is loaded as generation 0.
+//
+// Older firmware kept every category in one EEPROM image, which is
+// still read to migrate:
+//
+//   image:     header, then one block per category
+//   block:     category id, length, then the category's records
+//
+// Ids are a hash of the name, so settings can be added, removed or
+// reordered between firmware versions: a record without a matching
+// setting (or with a different type) is skipped and the setting keeps
+// its default. Values are stored as they are in memory, so loading
+// one is a memcpy. Each slot has its own CRC, the image CRC covers
+// everything after the image header.
+// ----------------------------------------------------------------
+
+#define SETTINGS_BINARY_HEADER_BYTE 0xFB
+#define SETTINGS_FORMAT_VERSION 1
+#define SETTINGS_SLOT_VERSION 2
+#define SETTINGS_SLOT_B_SUFFIX ".b"
+
+struct __attribute__((packed)) SettingsImageHeader
+{
+    uint8_t header;         // SETTINGS_BINARY_HEADER_BYTE
+    uint8_t version;        // SETTINGS_FORMAT_VERSION
+    uint16_t length;        // bytes after this header
+    uint32_t crc;           // CRC-32 of those bytes
+};
+
+struct __attribute__((packed)) SettingsSlotHeader
+{
+    uint8_t version;        // SETTINGS_SLOT_VERSION
+    uint32_t generation;    // higher is newer
+    uint16_t length;        // bytes of records after this header
+    uint32_t crc;           // CRC-32 of the fields above and the records
+};
+
+struct __attribute__((packed)) SettingsBlockHeader
+{
+    uint32_t categoryId;
+    uint16_t length;        // bytes of records after this header
+};
+
+struct __attribute__((packed)) SettingRecordHeader
+{
+    uint32_t settingId;
+    uint8_t type;           // SettingType
+    uint8_t length;         // bytes of value after this header
+};
+
+// 32 bit FNV-1a of the name, constexpr so a schema's ids are worked
+// out at compile time
+constexpr uint32_t settingsNameId(const char *name)
+{
+    uint32_t hash = 2166136261UL;
+    while (*name)
+    {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+// covers the slot header up to the CRC and the records after it
+inline uint32_t settingsSlotCrc(const SettingsSlotHeader &header, const uint8_t *records)
+{
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)&header, offsetof(SettingsSlotHeader, crc));
+    return esp_rom_crc32_le(crc, records, header.length);
+}
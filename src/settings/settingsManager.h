@@ -3,19 +3,44 @@
 #include <EEPROM.h>
 #include <string>
 #include <map>
-#include "SettingBase.h"
-#include "SettingsCategory.h"
+#include "settingBase.h"
+#include "settingsCategory.h"
+#include "settingsFormat.h"
+#include "settingsPersister.h"
 #include "../fanController.h"
 #include "../logger.h"
+#include "../modules/latencyHistogram.h"
+#include "../modules/allocationCounter.h"
 #include <nvs_flash.h>
+#include <esp_rom_crc.h>
+
+// Settings are kept in NVS, in two slots per category (see
+// settingsFormat.h), and a save only stages the categories that
+// changed for the persister task to write. The EEPROM is only read, to
+// migrate settings saved by older firmware.
+#define SETTINGS_NVS_NAMESPACE "settings"
+
 #define EEPROM_SIZE 512
-#define SETTINGS_HEADER_BYTE 0xFA
+#define SETTINGS_HEADER_BYTE 0xFA       // JSON, as saved by older firmware
 
 class SettingsManager
 {
 private:
     bool isInitialized = false;
     std::map<std::string, SettingsCategory> categories;
+    SettingsDirtyCount dirtyCount;      // every category's dirty settings
+    nvs_handle_t nvsHandle = 0;
+    SettingsPersister persister;
+
+    // save statistics, the persister counts what reaches the flash
+    uint32_t saves = 0;
+    uint32_t wholeImageBytes = 0;       // what rewriting everything would have written
+    LatencyHistogram stageLatency;
+
+    // the load at boot, heap figures from the native build only
+    uint32_t loadMicros = 0;
+    uint32_t loadAllocations = 0;
+    size_t loadPeakHeap = 0;
 
 public:
     SettingsManager()  {
@@ -32,8 +57,12 @@ public:
 
     SettingsCategory &addCategory(const std::string &name)
     {
-        SettingsCategory& newCategory = categories[name];
-        return newCategory;
+        auto [it, added] = categories.try_emplace(name);
+        if (added)
+        {
+            it->second.attach(&dirtyCount);
+        }
+        return it->second;
     }
 
     SettingsCategory *getCategory(const std::string &name)
@@ -53,72 +82,191 @@ public:
     }
     
 
+    // stages the changed categories, the persister task writes them
     void saveAll() {
         if (!isDirty()) {return;}
 
-        JsonDocument doc; 
-        JsonObject root = doc.to<JsonObject>();
+        uint32_t startCycles = LatencyHistogram::startTimer();
+        uint8_t records[SETTINGS_MAX_RECORDS_BYTES];
 
         for (auto &pair : categories)
         {
-            JsonObject categoryObj = root[pair.first].to<JsonObject>();
-            pair.second.toJson(categoryObj);
+            SettingsCategory &category = pair.second;
+            wholeImageBytes += sizeof(SettingsSlotHeader) + category.binarySize();
+            if (!category.isDirty())
+            {
+                continue;
+            }
+
+            size_t length = category.writeBinary(records, sizeof(records));
+            if (length == 0 && !category.empty())
+            {
+                Log.printfln("ERROR! Settings for %s don't fit in %u bytes, not saved", pair.first.c_str(), sizeof(records));
+                continue;
+            }
+
+            if (!persister.stage(pair.first.c_str(), records, length, category.getDirtyBytes()))
+            {
+                Log.printfln("ERROR! Settings for %s could not be staged", pair.first.c_str());
+                continue;
+            }
+            category.clearDirty();
         }
 
-        String jsonString;
-        serializeJson(doc, jsonString);
+        saves++;
+        stageLatency.recordSince(startCycles);
+    }
 
-        // Log.println("SettingsManager.saveAll: ");
-        // Log.printfln("String length: %d", jsonString.length() + 1);
-        // Log.println(jsonString.c_str());
+    // saves and writes everything now, e.g. before a restart
+    void flush() {
+        saveAll();
+        if (!persister.flush())
+        {
+            Log.println("ERROR! Settings could not all be written to flash");
+        }
+    }
 
-        // Write a header to the EEPROM to indicate the start of the settings
-        EEPROM.writeByte(0, SETTINGS_HEADER_BYTE);
-        EEPROM.writeString(1, jsonString);
+    void loadAll() {
 
-        // // Write the JSON string to the EEPROM
-        // for (size_t i = 0; i < jsonString.length(); i++)
-        // {
-        //     EEPROM.write(i + 1, jsonString[i]);
-        // }
-        // EEPROM.write(jsonString.length() + 1, 0); // Null terminator
+        isInitialized = true;
 
-        // Commit the changes to EEPROM
-        if (EEPROM.commit())
+        esp_err_t err = nvs_open(SETTINGS_NVS_NAMESPACE, NVS_READWRITE, &nvsHandle);
+        if (err != ESP_OK)
         {
-            Log.println("EEPROM successfully committed");
+            Log.printfln("ERROR! Opening NVS failed: %d", err);
+            return;
         }
-        else
+        persister.begin(nvsHandle);
+
+        uint32_t start = micros();
+        uint32_t allocationsBefore = getAllocationCount();
+        size_t heapBefore = getHeapInUse();
+        resetPeakHeap();
+
+        if (!loadFromNVS())
         {
-            Log.println("ERROR! EEPROM commit failed");
+            migrateFromEEPROM();
+        }
+
+        loadMicros = micros() - start;
+        loadAllocations = getAllocationCount() - allocationsBefore;
+        loadPeakHeap = getPeakHeap() - heapBefore;
+#ifdef ALLOCATION_COUNTER_AVAILABLE
+        Log.printfln("Settings: load took %u us, %u allocations, peak heap %u bytes", loadMicros, loadAllocations, loadPeakHeap);
+#endif
+    }
+
+    // false if no category was found
+    bool loadFromNVS() {
+        uint32_t start = micros();
+        int found = 0;
+        int loaded = 0;
+        SettingsLoadBuffer buffer;
+        for (auto &pair : categories)
+        {
+            const uint8_t *records;
+            int length = persister.load(pair.first.c_str(), buffer, records);
+            if (length < 0)
+            {
+                continue;
+            }
+            found++;
+            loaded += pair.second.readBinary(records, length);
         }
 
-        // Verify contents of EEPROM
-        Log.println("Verifying EEPROM contents: ");
-        Log.printf("Header: %d, ", EEPROM.read(0));
-        for (int i = 1; i <= 25 && i <= jsonString.length(); i++)
+        if (found == 0)
         {
-            Log.printf("%c", EEPROM.read(i));
+            return false;
         }
-        Log.println("");
+
+        Log.printfln("Settings: loaded %d settings from %d categories in %lu us", loaded, found, micros() - start);
+        return true;
     }
 
-    void loadAll() {
+    // Settings saved in the EEPROM by older firmware, binary or JSON.
+    // They are loaded, then marked dirty so the next save writes them
+    // all to NVS.
+    void migrateFromEEPROM() {
+        const uint8_t *image = EEPROM.getConstDataPtr();
+        if (image[0] == SETTINGS_HEADER_BYTE)
+        {
+            loadLegacyJson();
+        }
+        else
+        {
+            loadEEPROMImage();
+        }
 
-        isInitialized = true;
+        for (auto &pair : categories)
+        {
+            pair.second.markDirty();
+        }
+    }
+
+    void loadEEPROMImage() {
+        uint32_t start = micros();
 
         // Read the header from the EEPROM to check if the settings are valid
-        byte header = EEPROM.readByte(0);
-        if (header != SETTINGS_HEADER_BYTE)
+        const uint8_t *image = EEPROM.getConstDataPtr();
+
+        SettingsImageHeader header;
+        memcpy(&header, image, sizeof(header));
+        if (header.header != SETTINGS_BINARY_HEADER_BYTE)
+        {
+            Log.printfln("Settings: Invalid header: %d", header.header);
+            return;
+        }
+
+        if (header.version != SETTINGS_FORMAT_VERSION || header.length > EEPROM_SIZE - sizeof(header))
+        {
+            Log.printfln("Settings: Unsupported version %u or length %u", header.version, header.length);
+            return;
+        }
+
+        const uint8_t *body = image + sizeof(header);
+        if (esp_rom_crc32_le(0, body, header.length) != header.crc)
         {
-            Log.printfln("Settings: Invalid header: %d", header );
+            Log.println("Settings: CRC mismatch, using defaults");
             return;
         }
 
-        String jsonString = EEPROM.readString(1);
+        int loaded = 0;
+        size_t offset = 0;
+        while (offset + sizeof(SettingsBlockHeader) <= header.length)
+        {
+            SettingsBlockHeader block;
+            memcpy(&block, body + offset, sizeof(block));
+            offset += sizeof(block);
+            if (offset + block.length > header.length)
+            {
+                break;
+            }
+
+            for (auto &pair : categories)
+            {
+                if (settingsNameId(pair.first.c_str()) == block.categoryId)
+                {
+                    loaded += pair.second.readBinary(body + offset, block.length);
+                    break;
+                }
+            }
+            offset += block.length;
+        }
+
+        Log.printfln("Settings: loaded %d settings from %u bytes in %lu us", loaded, header.length, micros() - start);
+    }
+
+    // settings saved as JSON by older firmware
+    void loadLegacyJson() {
+        uint32_t start = micros();
+
+        // parsed where it is in the EEPROM's buffer, without copying it
+        // to a String first
+        const char *json = (const char *)EEPROM.getConstDataPtr() + 1;
+        size_t jsonLength = strnlen(json, EEPROM_SIZE - 1);
 
         JsonDocument doc;
-        DeserializationError error = deserializeJson(doc, jsonString);
+        DeserializationError error = deserializeJson(doc, json, jsonLength);
 
         if (error == DeserializationError::EmptyInput) {
             Log.println("Settings: No settings found");
@@ -138,13 +286,29 @@ public:
             JsonObject categoryObj = pair.value().as<JsonObject>();
             categories[categoryName].fromJson(categoryObj);
         }
+
+        Log.printfln("Settings: imported %u bytes of JSON settings in %lu us", jsonLength, micros() - start);
+    }
+
+    // every category, for export
+    void toJson(JsonObject &root) const
+    {
+        for (const auto &pair : categories)
+        {
+            JsonObject categoryObj = root[pair.first].to<JsonObject>();
+            pair.second.toJson(categoryObj);
+        }
     }
 
 
     // clear the settings and restart the ESP
     void factoryReset() 
     {
-        // Clear the EEPROM
+        persister.discard();
+        nvs_erase_all(nvsHandle);
+        nvs_commit(nvsHandle);
+
+        // and the old settings, or they would be migrated back
         EEPROM.writeByte(0, 0);
         EEPROM.commit();
 
@@ -153,13 +317,41 @@ public:
     }
 
     bool isDirty() const
-    {       
-        for (const auto& [name, category] : categories) {
-            if (category.isDirty()) {
-                return true;
-            }
-        }
-        return false;
+    {
+        return dirtyCount.dirty > 0;
+    }
+
+    uint32_t getDirtyCount() const
+    {
+        return dirtyCount.dirty;
+    }
+
+    void getInfoForLog(Logger &log) const
+    {
+        log.printfln("|> Settings: %u saves, %u bytes if saved whole", saves, wholeImageBytes);
+        log.printfln("|>  - Load: %u us, %u allocations, peak heap %u bytes", loadMicros, loadAllocations, loadPeakHeap);
+        log.printfln("|>  - Arena: %u of %u bytes used, %u settings on the heap",
+                     SettingsArena::getUsed(), SettingsArena::getCapacity(), SettingsArena::getOverflows());
+        stageLatency.printTo(log, "stage");
+        persister.getInfoForLog(log);
+    }
+
+    JsonDocument getInfoForJson() const
+    {
+        JsonDocument doc;
+        doc["saves"] = saves;
+        doc["wholeImageBytes"] = wholeImageBytes;
+        doc["loadUs"] = loadMicros;
+#ifdef ALLOCATION_COUNTER_AVAILABLE
+        doc["loadAllocations"] = loadAllocations;
+        doc["loadPeakHeap"] = loadPeakHeap;
+#endif
+        doc["arenaUsed"] = SettingsArena::getUsed();
+        doc["arenaCapacity"] = SettingsArena::getCapacity();
+        doc["arenaOverflows"] = SettingsArena::getOverflows();
+        stageLatency.addToJson(doc["stageLatencyUs"].to<JsonObject>());
+        persister.addToJson(doc["persister"].to<JsonObject>());
+        return doc;
     }
 
     size_t totalSize() const
@@ -0,0 +1,375 @@
+#include "settingsPersister.h"
+#include <esp_timer.h>
+
+void SettingsPersister::begin(nvs_handle_t handle)
+{
+    nvsHandle = handle;
+    stagedLock = xSemaphoreCreateMutex();
+    writeLock = xSemaphoreCreateMutex();
+
+    xTaskCreate(taskMain, "settings", SETTINGS_TASK_STACK_SIZE, this, SETTINGS_TASK_PRIORITY, &task);
+}
+
+// the category's entry, or a new one. Call with stagedLock held.
+SettingsPersister::StoredCategory *SettingsPersister::findCategory(const char *name)
+{
+    for (StoredCategory &category : stored)
+    {
+        if (category.name != nullptr && strcmp(category.name, name) == 0)
+        {
+            return &category;
+        }
+        if (category.name == nullptr)
+        {
+            // both slot keys must fit in an NVS key
+            if (strlen(name) + strlen(SETTINGS_SLOT_B_SUFFIX) >= NVS_KEY_NAME_MAX_SIZE)
+            {
+                return nullptr;
+            }
+            category.name = name;
+            snprintf(category.slotKeys[0], NVS_KEY_NAME_MAX_SIZE, "%s", name);
+            snprintf(category.slotKeys[1], NVS_KEY_NAME_MAX_SIZE, "%s" SETTINGS_SLOT_B_SUFFIX, name);
+            return &category;
+        }
+    }
+    return nullptr;
+}
+
+bool SettingsPersister::readSlot(StoredCategory &category, int slot, uint8_t *blob, uint32_t &generation,
+                                 const uint8_t *&records, size_t &length)
+{
+    size_t blobLength = SETTINGS_MAX_BLOB_BYTES;
+    if (nvs_get_blob(nvsHandle, category.slotKeys[slot], blob, &blobLength) != ESP_OK || blobLength == 0)
+    {
+        return false;
+    }
+
+    // saved before there were slots
+    if (slot == 0 && blob[0] == SETTINGS_FORMAT_VERSION)
+    {
+        generation = 0;
+        records = blob + 1;
+        length = blobLength - 1;
+        return true;
+    }
+
+    SettingsSlotHeader header;
+    if (blobLength >= sizeof(header))
+    {
+        memcpy(&header, blob, sizeof(header));
+        if (header.version == SETTINGS_SLOT_VERSION &&
+            header.length == blobLength - sizeof(header) &&
+            header.crc == settingsSlotCrc(header, blob + sizeof(header)))
+        {
+            generation = header.generation;
+            records = blob + sizeof(header);
+            length = header.length;
+            return true;
+        }
+    }
+
+    slotsRejected++;
+    Log.printfln("Settings: %s slot %c is damaged, ignored", category.name, 'A' + slot);
+    return false;
+}
+
+int SettingsPersister::load(const char *name, SettingsLoadBuffer &buffer, const uint8_t *&records)
+{
+    if (stagedLock == nullptr)
+    {
+        return -1;
+    }
+
+    xSemaphoreTake(stagedLock, portMAX_DELAY);
+    StoredCategory *category = findCategory(name);
+    xSemaphoreGive(stagedLock);
+    if (category == nullptr)
+    {
+        return -1;
+    }
+
+    // both slots, keeping the newest good one
+    uint32_t generations[2];
+    const uint8_t *slotRecords[2];
+    size_t lengths[2];
+    int newest = -1;
+    for (int slot = 0; slot < 2; slot++)
+    {
+        if (readSlot(*category, slot, buffer.slots[slot], generations[slot], slotRecords[slot], lengths[slot]) &&
+            (newest < 0 || (int32_t)(generations[slot] - generations[newest]) > 0))
+        {
+            newest = slot;
+        }
+    }
+
+    if (newest < 0)
+    {
+        return -1;
+    }
+
+    category->activeSlot = newest;
+    category->generation = generations[newest];
+    records = slotRecords[newest];
+    return lengths[newest];
+}
+
+bool SettingsPersister::stage(const char *name, const uint8_t *records, size_t length, size_t changedBytes)
+{
+    if (length > SETTINGS_MAX_RECORDS_BYTES || stagedLock == nullptr)
+    {
+        return false;
+    }
+
+    xSemaphoreTake(stagedLock, portMAX_DELAY);
+
+    StoredCategory *category = findCategory(name);
+    if (category == nullptr)
+    {
+        xSemaphoreGive(stagedLock);
+        return false;
+    }
+
+    if (category->staged)
+    {
+        // the changes are still unwritten, so they count as well
+        replaced++;
+        changedBytes += category->changedBytes;
+    }
+    else
+    {
+        if (stagedCount == 0)
+        {
+            firstStagedMillis = millis();
+        }
+        stagedCount++;
+    }
+
+    memcpy(category->data, records, length);
+    category->length = length;
+    category->changedBytes = changedBytes;
+    category->staged = true;
+    category->sequence++;
+    lastStagedMillis = millis();
+    stages++;
+
+    xSemaphoreGive(stagedLock);
+
+    xTaskNotifyGive(task);
+    return true;
+}
+
+bool SettingsPersister::flush()
+{
+    return writeLock == nullptr || writeStaged();
+}
+
+void SettingsPersister::discard()
+{
+    if (stagedLock == nullptr)
+    {
+        return;
+    }
+
+    // wait for a write in progress, so nothing lands after this returns
+    xSemaphoreTake(writeLock, portMAX_DELAY);
+    xSemaphoreTake(stagedLock, portMAX_DELAY);
+    for (StoredCategory &category : stored)
+    {
+        category.staged = false;
+    }
+    stagedCount = 0;
+    xSemaphoreGive(stagedLock);
+    xSemaphoreGive(writeLock);
+}
+
+void SettingsPersister::taskMain(void *parameter)
+{
+    static_cast<SettingsPersister *>(parameter)->run();
+}
+
+void SettingsPersister::run()
+{
+    for (;;)
+    {
+        // sleep until something is staged
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // then until the changes have been quiet for the debounce time,
+        // or the oldest has waited the longest allowed. Another stage()
+        // wakes us early to work it out again.
+        for (;;)
+        {
+            xSemaphoreTake(stagedLock, portMAX_DELAY);
+            bool anyStaged = stagedCount > 0;
+            unsigned long quietDue = lastStagedMillis + SETTINGS_SAVE_DEBOUNCE_MILLIS;
+            unsigned long latestDue = firstStagedMillis + SETTINGS_SAVE_MAX_DELAY_MILLIS;
+            xSemaphoreGive(stagedLock);
+
+            if (!anyStaged)
+            {
+                retryBackoffMillis = 0;
+                break;      // flushed meanwhile
+            }
+
+            unsigned long now = millis();
+            long waitMillis = min((long)(quietDue - now), (long)(latestDue - now));
+            if (retryBackoffMillis > 0)
+            {
+                waitMillis = max(waitMillis, (long)(retryDueMillis - now));
+            }
+            if (waitMillis <= 0)
+            {
+                if (writeStaged())
+                {
+                    retryBackoffMillis = 0;
+                    break;
+                }
+
+                // still staged, try again later
+                retryBackoffMillis = retryBackoffMillis == 0 ? SETTINGS_RETRY_MIN_MILLIS
+                                                             : min(retryBackoffMillis * 2, (unsigned long)SETTINGS_RETRY_MAX_MILLIS);
+                retryDueMillis = millis() + retryBackoffMillis;
+                Log.printfln("Settings: write failed, retrying in %lu ms", retryBackoffMillis);
+                continue;
+            }
+
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(waitMillis));
+        }
+    }
+}
+
+bool SettingsPersister::writeStaged()
+{
+    xSemaphoreTake(writeLock, portMAX_DELAY);
+
+    // not the cycle counter, this runs on the unpinned settings task (or
+    // the loop, for flush()) and can move cores while it waits for NVS
+    int64_t start = esp_timer_get_time();
+    int written = 0;
+    bool failed = false;
+
+    // what each category's write was, applied once the commit succeeds
+    int8_t slots[SETTINGS_MAX_CATEGORIES];
+    uint32_t sequences[SETTINGS_MAX_CATEGORIES];
+    size_t lengths[SETTINGS_MAX_CATEGORIES];
+    size_t changed[SETTINGS_MAX_CATEGORIES];
+
+    // one category at a time is copied out under the lock and written
+    // without it, so stage() never waits for the flash. It stays staged
+    // until it is committed.
+    uint8_t blob[SETTINGS_MAX_BLOB_BYTES];
+    SettingsSlotHeader header;
+    for (int i = 0; i < SETTINGS_MAX_CATEGORIES; i++)
+    {
+        StoredCategory &category = stored[i];
+        slots[i] = -1;
+
+        xSemaphoreTake(stagedLock, portMAX_DELAY);
+        bool isStaged = category.staged;
+        lengths[i] = category.length;
+        changed[i] = category.changedBytes;
+        sequences[i] = category.sequence;
+        if (isStaged)
+        {
+            memcpy(blob + sizeof(header), category.data, lengths[i]);
+        }
+        xSemaphoreGive(stagedLock);
+
+        if (!isStaged)
+        {
+            continue;
+        }
+
+        // over the older copy, the newest stays intact until this one is
+        int slot = category.activeSlot == 0 ? 1 : 0;
+        header.version = SETTINGS_SLOT_VERSION;
+        header.generation = category.generation + 1;
+        header.length = lengths[i];
+        header.crc = settingsSlotCrc(header, blob + sizeof(header));
+        memcpy(blob, &header, sizeof(header));
+
+        esp_err_t err = nvs_set_blob(nvsHandle, category.slotKeys[slot], blob, sizeof(header) + lengths[i]);
+        if (err != ESP_OK)
+        {
+            writeErrors++;
+            failed = true;
+            Log.printfln("ERROR! Saving settings for %s failed: %d", category.name, err);
+            continue;
+        }
+
+        slots[i] = slot;
+        written++;
+    }
+
+    if (written > 0)
+    {
+        esp_err_t err = nvs_commit(nvsHandle);
+        commits++;
+        commitLatency.record(esp_timer_get_time() - start);
+
+        if (err != ESP_OK)
+        {
+            // nothing moves to the new slots, they are all written again
+            writeErrors++;
+            failed = true;
+            Log.printfln("ERROR! NVS commit failed: %d", err);
+        }
+        else
+        {
+            for (int i = 0; i < SETTINGS_MAX_CATEGORIES; i++)
+            {
+                if (slots[i] < 0)
+                {
+                    continue;
+                }
+
+                StoredCategory &category = stored[i];
+                category.activeSlot = slots[i];
+                category.generation++;
+                keysWritten++;
+                bytesWritten += sizeof(header) + lengths[i];
+                bytesChanged += changed[i];
+
+                // unless a newer copy was staged while this one was written,
+                // which only still has its own changes to write
+                xSemaphoreTake(stagedLock, portMAX_DELAY);
+                if (category.sequence == sequences[i])
+                {
+                    category.staged = false;
+                    stagedCount--;
+                }
+                else
+                {
+                    category.changedBytes -= min(changed[i], category.changedBytes);
+                }
+                xSemaphoreGive(stagedLock);
+            }
+        }
+    }
+
+    xSemaphoreGive(writeLock);
+    return !failed;
+}
+
+void SettingsPersister::getInfoForLog(Logger &log) const
+{
+    log.printfln("|>  - Persister: %u changes staged (%u replaced before writing), %u commits, %u errors, %u damaged slots",
+                 stages, replaced, commits, writeErrors, slotsRejected);
+    log.printfln("|>  - Written: %u keys, %u bytes for %u bytes changed (x%u)",
+                 keysWritten, bytesWritten, bytesChanged, getWriteAmplification());
+    commitLatency.printTo(log, "commit");
+}
+
+void SettingsPersister::addToJson(JsonObject json) const
+{
+    json["stages"] = stages;
+    json["replaced"] = replaced;
+    json["commits"] = commits;
+    json["errors"] = writeErrors;
+    json["slotsRejected"] = slotsRejected;
+    json["keysWritten"] = keysWritten;
+    json["bytesWritten"] = bytesWritten;
+    json["bytesChanged"] = bytesChanged;
+    json["writeAmplification"] = getWriteAmplification();
+    commitLatency.addToJson(json["commitLatencyUs"].to<JsonObject>());
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <nvs.h>
+#include "../config.h"
+#include "../logger.h"
+#include "../modules/latencyHistogram.h"
+#include "settingsFormat.h"
+
+// ----------------------------------------------------------------
+// Write-behind settings persister
+//
+// The main loop stages a copy of each changed category's blob, which
+// is only a memcpy, and a low priority task writes them to NVS. The
+// task waits for SETTINGS_SAVE_DEBOUNCE_MILLIS without a new change,
+// so a burst of changes becomes one commit, but never holds a change
+// for more than SETTINGS_SAVE_MAX_DELAY_MILLIS.
+//
+// A newer copy of a category replaces a staged one. flush() writes
+// whatever is staged straight away in the caller, for before a restart.
+// A copy stays staged until it has been written and committed, so one
+// that fails is tried again, backing off from SETTINGS_RETRY_MIN_MILLIS.
+//
+// Each category is written to its A and B slots in turn (see
+// settingsFormat.h), and load() returns the newest intact copy.
+// ----------------------------------------------------------------
+
+#define SETTINGS_MAX_BLOB_BYTES 512     // slot header and the category's records, FanPWM's rpmCurve is the largest
+#define SETTINGS_MAX_RECORDS_BYTES (SETTINGS_MAX_BLOB_BYTES - sizeof(SettingsSlotHeader))
+
+// room for load() to read both slots of a category into
+struct SettingsLoadBuffer
+{
+    uint8_t slots[2][SETTINGS_MAX_BLOB_BYTES];
+};
+
+class SettingsPersister
+{
+private:
+    struct StoredCategory
+    {
+        const char *name = nullptr;     // owned by the manager
+        char slotKeys[2][NVS_KEY_NAME_MAX_SIZE];
+
+        // the newest copy in flash, only used by the writer once loaded
+        int8_t activeSlot = -1;
+        uint32_t generation = 0;
+
+        uint8_t data[SETTINGS_MAX_RECORDS_BYTES];
+        size_t length = 0;              // of the records
+        size_t changedBytes = 0;
+        bool staged = false;
+        uint32_t sequence = 0;          // bumped by stage(), a write only unstages the copy it took
+    };
+
+    nvs_handle_t nvsHandle = 0;
+    TaskHandle_t task = nullptr;
+
+    // stagedLock guards the staged blobs and times, writeLock makes the
+    // task and flush() take turns writing to NVS
+    SemaphoreHandle_t stagedLock = nullptr;
+    SemaphoreHandle_t writeLock = nullptr;
+    StoredCategory stored[SETTINGS_MAX_CATEGORIES];
+    int stagedCount = 0;
+    unsigned long firstStagedMillis = 0;
+    unsigned long lastStagedMillis = 0;
+
+    // after a failed write, only used by the task
+    unsigned long retryDueMillis = 0;
+    unsigned long retryBackoffMillis = 0;   // 0 when nothing failed
+
+    // statistics. Write amplification is the bytes written to flash
+    // over the bytes of the settings that changed.
+    uint32_t stages = 0;
+    uint32_t replaced = 0;              // staged copies overwritten before being written
+    uint32_t commits = 0;
+    uint32_t keysWritten = 0;
+    uint32_t bytesWritten = 0;
+    uint32_t bytesChanged = 0;
+    uint32_t writeErrors = 0;
+    uint32_t slotsRejected = 0;         // found damaged when loading
+    LatencyHistogram commitLatency;
+
+public:
+    // starts the task, call once NVS is open
+    void begin(nvs_handle_t handle);
+
+    // reads both slots of a category into buffer and points records at
+    // the newest intact copy's, in place. Returns their length, or -1
+    // if neither slot has a good copy.
+    int load(const char *name, SettingsLoadBuffer &buffer, const uint8_t *&records);
+
+    // copies a category's records to be written, false if they can't be kept
+    bool stage(const char *name, const uint8_t *records, size_t length, size_t changedBytes);
+
+    // writes everything staged now, returns once it is in flash, false
+    // if something couldn't be written (it stays staged)
+    bool flush();
+
+    // drops everything staged, e.g. before a factory reset
+    void discard();
+
+    bool hasStaged() const { return stagedCount > 0; }
+
+    uint32_t getWriteAmplification() const
+    {
+        return bytesChanged > 0 ? bytesWritten / bytesChanged : 0;
+    }
+
+    void getInfoForLog(Logger &log) const;
+    void addToJson(JsonObject json) const;
+
+private:
+    StoredCategory *findCategory(const char *name);
+    bool readSlot(StoredCategory &category, int slot, uint8_t *blob, uint32_t &generation,
+                  const uint8_t *&records, size_t &length);
+
+    static void taskMain(void *parameter);
+    void run();
+    bool writeStaged();
+};
@@ -0,0 +1,215 @@
+#include "simBenchmarks.h"
+
+#if defined(FAN_NATIVE_SIM) && defined(ENABLE_MQTT)
+
+#include "fanController.h"
+#include <charconv>
+#include <map>
+#include <string>
+#include <vector>
+#include <esp_timer.h>
+
+#define DISPATCH_BENCHMARK_DEFAULT_COMMANDS 10000
+#define DISPATCH_BENCHMARK_MAX_COMMANDS 1000000
+#define SETTINGS_BENCHMARK_DEFAULT_LOOKUPS 100000
+#define SETTINGS_BENCHMARK_MAX_LOOKUPS 1000000
+#define DIRTY_BENCHMARK_DEFAULT_SETTINGS 300
+#define DIRTY_BENCHMARK_MAX_SETTINGS 2000
+#define DIRTY_BENCHMARK_SETTINGS_PER_CATEGORY 16
+#define DIRTY_BENCHMARK_CHECKS 1000
+
+// the count from the payload, the default if there is none, false if
+// it is above the maximum
+static bool parseCount(const char *name, std::string_view payload, uint32_t defaultCount, uint32_t maxCount, uint32_t &count)
+{
+    count = defaultCount;
+    std::from_chars(payload.data(), payload.data() + payload.size(), count);
+    if (count > maxCount)
+    {
+        Log.printfln("BENCHMARK: %s count %u is over the maximum of %u", name, count, maxCount);
+        return false;
+    }
+    return true;
+}
+
+// Dispatches COMMAND/benchmark/noop over and over through
+// MQTT.dispatch(), to see what routing a command costs.
+static void runDispatchBenchmark(uint32_t commands)
+{
+    std::string commandTopic(MQTT.getTopicPrefix());
+    commandTopic += "COMMAND/benchmark/noop";
+
+    uint32_t allocationsBefore = getAllocationCount();
+    int64_t start = esp_timer_get_time();
+
+    for (uint32_t i = 0; i < commands; i++)
+    {
+        MQTT.dispatch(commandTopic, "1");
+    }
+
+    int64_t elapsedMicros = esp_timer_get_time() - start;
+    uint32_t allocations = getAllocationCount() - allocationsBefore;
+
+    uint32_t perSecond = elapsedMicros > 0 ? (uint64_t)commands * 1000000 / elapsedMicros : 0;
+    float allocationsPerCommand = commands > 0 ? (float)allocations / commands : 0;
+
+    Log.printfln("BENCHMARK: dispatched %u commands in %lld us, %u/second, %.2f allocations per command",
+                 commands, elapsedMicros, perSecond, allocationsPerCommand);
+
+    JsonDocument doc;
+    doc["commands"] = commands;
+    doc["elapsedUs"] = elapsedMicros;
+    doc["perSecond"] = perSecond;
+    doc["allocationsPerCommand"] = allocationsPerCommand;
+    MQTT.publishJson("diagnostics/dispatchBenchmark", doc);
+}
+
+// Reads FanPWM's pmwResolution, which getPWMValue() needs for every
+// duty write, by name and then through its handle, to see what a
+// lookup costs.
+static void runSettingsBenchmark(uint32_t lookups)
+{
+    SettingsCategory *category = settingsManager.getCategory(FAN_PWM_MODULE_NAME);
+    if (category == nullptr)
+    {
+        return;
+    }
+    Setting<byte> *handle = category->getSetting(FanPWMSettings::pmwResolution);
+
+    volatile uint32_t sink = 0;     // keeps the reads from being optimised away
+
+    uint32_t allocationsBefore = getAllocationCount();
+    int64_t start = esp_timer_get_time();
+    for (uint32_t i = 0; i < lookups; i++)
+    {
+        sink = sink + category->getValue<byte>("pmwResolution");
+    }
+    int64_t byNameMicros = esp_timer_get_time() - start;
+    uint32_t byNameAllocations = getAllocationCount() - allocationsBefore;
+
+    start = esp_timer_get_time();
+    for (uint32_t i = 0; i < lookups; i++)
+    {
+        sink = sink + handle->get();
+    }
+    int64_t byHandleMicros = esp_timer_get_time() - start;
+
+    uint32_t byNameNanos = lookups > 0 ? byNameMicros * 1000 / lookups : 0;
+    uint32_t byHandleNanos = lookups > 0 ? byHandleMicros * 1000 / lookups : 0;
+
+    Log.printfln("BENCHMARK: %u settings lookups, by name %u ns each (%u allocations), by handle %u ns each",
+                 lookups, byNameNanos, byNameAllocations, byHandleNanos);
+
+    JsonDocument doc;
+    doc["lookups"] = lookups;
+    doc["byNameNs"] = byNameNanos;
+    doc["byHandleNs"] = byHandleNanos;
+    doc["byNameAllocations"] = byNameAllocations;
+    MQTT.publishJson("diagnostics/settingsBenchmark", doc);
+}
+
+// Builds settingCount scratch settings in categories of 16, all saved,
+// and checks them for changes the way the 500 ms settings job used to,
+// by walking every setting of every category, and with the dirty
+// count it uses now. Publishes to diagnostics/dirtyBenchmark.
+static void runDirtyBenchmark(uint32_t settingCount)
+{
+    uint32_t categoryCount = (settingCount + DIRTY_BENCHMARK_SETTINGS_PER_CATEGORY - 1) / DIRTY_BENCHMARK_SETTINGS_PER_CATEGORY;
+
+    SettingsDirtyCount managerCount;
+    std::vector<SettingsDirtyCount> categoryCounts(categoryCount);
+    std::map<std::string, std::map<std::string, SettingBase *>> categories;
+    static constexpr SettingSpec<int> scratchSpec("scratch", 0);
+    std::vector<Setting<int>> scratch;
+    scratch.reserve(settingCount);
+    for (uint32_t i = 0; i < settingCount; i++)
+    {
+        uint32_t category = i / DIRTY_BENCHMARK_SETTINGS_PER_CATEGORY;
+        categoryCounts[category].parent = &managerCount;
+
+        Setting<int> &setting = scratch.emplace_back(scratchSpec);
+        setting.attach(&categoryCounts[category]);
+        setting.clearDirty();
+        categories["category" + std::to_string(category)]["setting" + std::to_string(i)] = &setting;
+    }
+
+    volatile uint32_t sink = 0;     // keeps the checks from being optimised away
+
+    int64_t start = esp_timer_get_time();
+    for (uint32_t check = 0; check < DIRTY_BENCHMARK_CHECKS; check++)
+    {
+        bool dirty = false;
+        for (const auto &category : categories)
+        {
+            for (const auto &setting : category.second)
+            {
+                if (setting.second->isDirty())
+                {
+                    dirty = true;
+                    break;
+                }
+            }
+            if (dirty)
+            {
+                break;
+            }
+        }
+        sink = sink + dirty;
+    }
+    int64_t scanMicros = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    for (uint32_t check = 0; check < DIRTY_BENCHMARK_CHECKS; check++)
+    {
+        sink = sink + (managerCount.dirty > 0);
+    }
+    int64_t countMicros = esp_timer_get_time() - start;
+
+    uint32_t scanNanos = scanMicros * 1000 / DIRTY_BENCHMARK_CHECKS;
+    uint32_t countNanos = countMicros * 1000 / DIRTY_BENCHMARK_CHECKS;
+
+    Log.printfln("BENCHMARK: dirty check of %u settings in %u categories, walking them %u ns, dirty count %u ns",
+                 settingCount, categoryCount, scanNanos, countNanos);
+
+    JsonDocument doc;
+    doc["settings"] = settingCount;
+    doc["categories"] = categoryCount;
+    doc["scanNs"] = scanNanos;
+    doc["countNs"] = countNanos;
+    MQTT.publishJson("diagnostics/dirtyBenchmark", doc);
+}
+
+static void handleBenchmarkCommand(std::string_view command, std::string_view payload)
+{
+    uint32_t count;
+    if (command == "dispatch")
+    {
+        if (parseCount("dispatch", payload, DISPATCH_BENCHMARK_DEFAULT_COMMANDS, DISPATCH_BENCHMARK_MAX_COMMANDS, count))
+        {
+            runDispatchBenchmark(count);
+        }
+    }
+    else if (command == "settings")
+    {
+        if (parseCount("settings", payload, SETTINGS_BENCHMARK_DEFAULT_LOOKUPS, SETTINGS_BENCHMARK_MAX_LOOKUPS, count))
+        {
+            runSettingsBenchmark(count);
+        }
+    }
+    else if (command == "dirty")
+    {
+        if (parseCount("dirty", payload, DIRTY_BENCHMARK_DEFAULT_SETTINGS, DIRTY_BENCHMARK_MAX_SETTINGS, count))
+        {
+            runDirtyBenchmark(count);
+        }
+    }
+
+    // "noop" is the dispatch benchmark's own command, nothing to do
+}
+
+void registerSimBenchmarks()
+{
+    MQTTController::registerCallback("benchmark", handleBenchmarkCommand);
+}
+
+#endif
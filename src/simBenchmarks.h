@@ -0,0 +1,18 @@
+#pragma once
+#include "config.h"
+
+// ----------------------------------------------------------------
+// Native simulation benchmarks
+//
+// Micro benchmarks run with COMMAND/benchmark/<name> <count>. They are
+// only built into the native simulation, never into the firmware, and
+// each one refuses a count above its maximum so a stray command can't
+// exhaust the heap or stall the loop. Results are logged and published
+// to diagnostics/<name>Benchmark.
+// ----------------------------------------------------------------
+
+#if defined(FAN_NATIVE_SIM) && defined(ENABLE_MQTT)
+
+void registerSimBenchmarks();
+
+#endif